@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <cstddef>
+#include <atomic>
+#include <new>
+#include "alloc_count.h"
+
+// The complete set of replaceable allocation functions: plain, array, nothrow and aligned, and
+// the sized deletes. They all end in malloc/aligned_alloc and free.
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocations(0);
+
+bool allocations_counted() {
+	return true;
+}
+
+void count_allocations(bool on) {
+	counting.store(on);
+}
+
+long allocation_count() {
+	return allocations.load();
+}
+
+static void *allocate(size_t size, size_t align) {
+	if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+	if (!size) size = 1;
+	if (align<=alignof(std::max_align_t)) return malloc(size);
+	return aligned_alloc(align, (size+align-1)/align*align);
+}
+
+static void *allocate_or_throw(size_t size, size_t align) {
+	void *p = allocate(size, align);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size) {
+	return allocate_or_throw(size, 0);
+}
+
+void *operator new[](size_t size) {
+	return allocate_or_throw(size, 0);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+	return allocate_or_throw(size, size_t(align));
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+	return allocate_or_throw(size, size_t(align));
+}
+
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	return allocate(size, size_t(align));
+}
+
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	return allocate(size, size_t(align));
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
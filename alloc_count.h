@@ -0,0 +1,15 @@
+#ifndef __ALLOC_COUNT_H__
+#define __ALLOC_COUNT_H__
+
+// Allocation counting for the benchmark suite. alloc_count.cpp replaces every global operator
+// new and delete and is only linked into the bench binary (make bench); main keeps the library
+// allocator, where these are the weak defaults of bench_suite.cpp and nothing is counted.
+
+// true when the replaced allocator is linked in
+bool allocations_counted();
+// counting is off until turned on, so that only the measured runs pay for it
+void count_allocations(bool on);
+// allocations made while counting was on
+long allocation_count();
+
+#endif //__ALLOC_COUNT_H__
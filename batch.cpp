@@ -0,0 +1,145 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include "batch.h"
+#include "profile.h"
+
+bool read_camera_path(const char *filename, std::vector<CameraPose> &poses) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		std::cerr << "can't open camera path " << filename << "\n";
+		return false;
+	}
+	std::string line;
+	for (int n=1; std::getline(in, line); n++) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first==std::string::npos || line[first]=='#') continue;
+		std::istringstream iss(line);
+		CameraPose p;
+		iss >> p.eye.x >> p.eye.y >> p.eye.z >> p.center.x >> p.center.y >> p.center.z >> p.up.x >> p.up.y >> p.up.z;
+		if (iss.fail() || (p.eye-p.center).norm()==0) {
+			std::cerr << "bad camera pose at " << filename << ":" << n << "\n";
+			return false;
+		}
+		poses.push_back(p);
+	}
+	return true;
+}
+
+bool orbit_path(const char *spec, const CameraPose &start, std::vector<CameraPose> &poses) {
+	Vec3f d = start.eye-start.center;
+	float radius = std::sqrt(d.x*d.x + d.z*d.z);
+	float height = d.y;
+	char *end = NULL;
+	int frames = (int)strtol(spec, &end, 10);
+	if (*end==',') radius = strtof(end+1, &end);
+	if (*end==',') height = strtof(end+1, &end);
+	if (*end || frames<=0 || radius<=0) {
+		std::cerr << "bad orbit " << spec << ", expected frames[,radius[,height]]\n";
+		return false;
+	}
+	float phi0 = std::atan2(d.x, d.z);
+	for (int i=0; i<frames; i++) {
+		float phi = phi0 + 2.f*float(M_PI)*i/frames;
+		CameraPose p = start;
+		p.eye = start.center + Vec3f(radius*std::sin(phi), height, radius*std::cos(phi));
+		poses.push_back(p);
+	}
+	return true;
+}
+
+bool frame_pattern(const char *pattern) {
+	int conversions = 0;
+	for (const char *p = pattern; *p; p++) {
+		if (*p!='%') continue;
+		if (*++p=='%') continue;
+		while (*p && strchr("-+ #0", *p)) p++;
+		while (isdigit((unsigned char)*p)) p++;
+		if (*p=='.') {
+			p++;
+			while (isdigit((unsigned char)*p)) p++;
+		}
+		if (!*p || !strchr("diuoxX", *p)) {
+			conversions = -1;
+			break;
+		}
+		conversions++;
+	}
+	if (conversions!=1) {
+		std::cerr << "bad output pattern " << pattern << ", expected a single integer conversion such as frame%04d.tga\n";
+		return false;
+	}
+	return true;
+}
+
+FrameWriter::FrameWriter(int width, int height, int bpp) : current_(0), writer_(NULL), pending_(false), stop_(false), write_ms_(0) {
+	images_[0] = TGAImage(width, height, bpp);
+	images_[1] = TGAImage(width, height, bpp);
+	thread_ = std::thread(&FrameWriter::worker_loop, this);
+}
+
+FrameWriter::~FrameWriter() {
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this]() { return !pending_; });
+		stop_ = true;
+	}
+	wake_.notify_one();
+	thread_.join();
+}
+
+TGAImage &FrameWriter::image() {
+	return images_[current_];
+}
+
+void FrameWriter::worker_loop() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		wake_.wait(lock, [this]() { return pending_ || stop_; });
+		if (!pending_) return;
+		TGAImage &img = images_[1-current_];
+		std::string filename = filename_;
+		lock.unlock();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			PROFILE_SCOPE("frame output");
+			img.flip_vertically(); // origin at the left bottom corner, as for the single frame
+			if (!writer_.write(img, filename.c_str())) std::cerr << "can't write " << filename << "\n";
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		lock.lock();
+		write_ms_ += std::chrono::duration<double, std::milli>(end-start).count();
+		latency_.push_back(std::chrono::duration<double, std::milli>(end-started_).count());
+		pending_ = false;
+		done_.notify_all();
+	}
+}
+
+void FrameWriter::submit(const std::string &filename, std::chrono::steady_clock::time_point started) {
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this]() { return !pending_; });
+		filename_ = filename;
+		started_ = started;
+		current_ = 1-current_;
+		pending_ = true;
+	}
+	wake_.notify_one();
+}
+
+void FrameWriter::finish() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_.wait(lock, [this]() { return !pending_; });
+}
+
+const std::vector<double> &FrameWriter::latencies() const {
+	return latency_;
+}
+
+double FrameWriter::write_ms() const {
+	return write_ms_;
+}
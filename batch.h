@@ -0,0 +1,60 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "tga_writer.h"
+#include "renderer.h"
+
+// One pose per line, "eye.x eye.y eye.z center.x center.y center.z up.x up.y up.z"; blank lines
+// and lines starting with # are skipped. Poses are appended, false on an unreadable file or line.
+bool read_camera_path(const char *filename, std::vector<CameraPose> &poses);
+
+// "frames[,radius[,height]]": frames poses evenly spaced on a horizontal circle around
+// start.center, beginning at start.eye, whose distance and height are the defaults
+bool orbit_path(const char *spec, const CameraPose &start, std::vector<CameraPose> &poses);
+
+// true if pattern can be given to printf with the frame number: exactly one int conversion
+// (%d, %i, %u, %o, %x or %X with flags, width and precision but no length or *) and no other
+// directive than %%
+bool frame_pattern(const char *pattern);
+
+// Double-buffered frame output. image() is the buffer the current frame is rendered into;
+// submit() hands it to a background thread that flips, encodes and writes it, and switches to the
+// other buffer, so frame N is written while frame N+1 is rasterized. submit() only blocks when
+// the previous frame is still being written.
+class FrameWriter {
+private:
+	TGAImage images_[2];
+	int current_;
+	TGAWriter writer_;
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable wake_, done_;
+	bool pending_, stop_;
+	std::string filename_;
+	std::chrono::steady_clock::time_point started_;
+	std::vector<double> latency_; // ms from the start of a frame to the end of its write
+	double write_ms_;
+	void worker_loop();
+	FrameWriter(const FrameWriter &);
+	FrameWriter & operator =(const FrameWriter &);
+public:
+	FrameWriter(int width, int height, int bpp);
+	~FrameWriter();
+	TGAImage &image();
+	// started is when the rendering of the frame began, for the latency statistics
+	void submit(const std::string &filename, std::chrono::steady_clock::time_point started);
+	// waits for the last write
+	void finish();
+	const std::vector<double> &latencies() const;
+	double write_ms() const;
+};
+
+#endif //__BATCH_H__
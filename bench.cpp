@@ -0,0 +1,548 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include "bench.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "vertex.h"
+#include "cull.h"
+#include "pipeline.h"
+#include "tga_writer.h"
+#include "renderer.h"
+#include "batch.h"
+#include "shadow.h"
+#include "msaa.h"
+
+static const int BENCH_RUNS = 7;
+
+// keeps the compiler from dropping the measured work
+static volatile uint32_t bench_sink;
+
+// median over BENCH_RUNS runs of f(), in seconds
+template <class F> static double median_seconds(F f) {
+	std::vector<double> t;
+	for (int r=0; r<BENCH_RUNS; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		t.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+	}
+	std::sort(t.begin(), t.end());
+	return t[t.size()/2];
+}
+
+static void report(const char *bench, const std::string &what, double seconds, double items, const char *unit) {
+	std::cerr << "# bench " << bench << " " << what << ": " << items/seconds/1e6 << " M" << unit << "/s, "
+	          << seconds/items*1e9 << " ns/" << unit << std::endl;
+}
+
+struct SamplePoint {
+	float u, v, lod;
+};
+
+// Texture sampler throughput: screen-order walks at 1:1 and 4:1 minification, as the rasterizer
+// issues them, and uniformly random uv/lod, the worst case for the cache.
+static void bench_sampler(BenchScene &scene) {
+	Model &model = scene.model;
+	const Texture &tex = model.diffuse_texture();
+	if (tex.empty()) {
+		std::cerr << "# bench sampler: the model has no diffuse texture\n";
+		return;
+	}
+	const int nsamples = 1<<20;
+	struct Pattern {
+		std::string name;
+		std::vector<SamplePoint> pts;
+	} patterns[3];
+	for (int p=0; p<2; p++) {
+		int scale = p ? 4 : 1;
+		int n = std::max(1, tex.width(0)/scale), m = std::max(1, tex.height(0)/scale);
+		patterns[p].name = p ? "minified 4:1" : "coherent 1:1";
+		for (int i=0; (int)patterns[p].pts.size()<nsamples; i++) {
+			int x = i%n, y = (i/n)%m;
+			SamplePoint s = {(x+.5f)/n, (y+.5f)/m, std::log2(float(scale))};
+			patterns[p].pts.push_back(s);
+		}
+	}
+	patterns[2].name = "random";
+	uint32_t seed = 12345;
+	for (int i=0; i<nsamples; i++) {
+		float r[3];
+		for (int k=0; k<3; k++) {
+			seed = seed*1664525u + 1013904223u;
+			r[k] = (seed>>8)/float(1<<24);
+		}
+		SamplePoint s = {r[0], r[1], r[2]*(tex.nlevels()-1)};
+		patterns[2].pts.push_back(s);
+	}
+
+	const char *names[4] = {"point (TGAImage)", "nearest", "bilinear", "trilinear"};
+	for (int p=0; p<3; p++) {
+		const std::vector<SamplePoint> &pts = patterns[p].pts;
+		for (int f=FILTER_POINT; f<=FILTER_TRILINEAR; f++) {
+			double seconds = median_seconds([&]() {
+				uint32_t acc = 0;
+				if (f==FILTER_POINT) {
+					for (size_t i=0; i<pts.size(); i++) acc += model.diffuse(Vec2f(pts[i].u, pts[i].v)).val;
+				} else {
+					for (size_t i=0; i<pts.size(); i++) acc += tex.sample(pts[i].u, pts[i].v, pts[i].lod, TextureFilter(f));
+				}
+				bench_sink = acc;
+			});
+			report("sampler", patterns[p].name + " " + names[f], seconds, pts.size(), "sample");
+		}
+	}
+}
+
+// median time of a full frame through the programmable path, serially
+template <class Shader> static double frame_seconds(BenchScene &scene, const std::vector<ShadedTriangle> &tris, const Shader &shader, long &fragments) {
+	ThreadPool pool(1);
+	TGAImage image(scene.width, scene.height, TGAImage::RGB);
+	std::vector<float> zbuffer(scene.width*scene.height);
+	return median_seconds([&]() {
+		std::fill(zbuffer.begin(), zbuffer.end(), -std::numeric_limits<float>::max());
+		fragments = render_shaded(tris, shader, image, zbuffer.data(), (Tiler *)NULL, pool);
+	});
+}
+
+// the same frame with virtual calls, then with inlined ones
+template <class Shader> static void bench_shader_frame(BenchScene &scene, const char *name, Shader &shader) {
+	PrimitiveCuller culler(scene.width, scene.height);
+	std::vector<ShadedTriangle> tris;
+	assemble_shaded(scene.model, shader, culler, tris);
+	long fragments = 0;
+	double tv = frame_seconds(scene, tris, static_cast<const IShader &>(shader), fragments);
+	double tt = frame_seconds(scene, tris, shader, fragments);
+	report("shader", std::string(name) + " virtual", tv, fragments, "fragment");
+	report("shader", std::string(name) + " template", tt, fragments, "fragment");
+	std::cerr << "# bench shader " << name << " template speedup " << tv/tt << "x" << std::endl;
+}
+
+// virtual dispatch against the template-specialized rasterizer, for every built-in shader
+static void bench_shader(BenchScene &scene) {
+	ThreadPool pool(1);
+	VertexProcessor vertices;
+	vertices.transform(scene.model, scene.MVP, pool);
+	ShaderContext ctx(scene.model, vertices, scene.light, scene.eye);
+	FlatShader flat(ctx);
+	GouraudShader gouraud(ctx);
+	TexturedShader textured(ctx);
+	PhongShader phong(ctx);
+	MappedShader mapped(ctx);
+	bench_shader_frame(scene, "flat", flat);
+	bench_shader_frame(scene, "gouraud", gouraud);
+	bench_shader_frame(scene, "textured", textured);
+	bench_shader_frame(scene, "phong", phong);
+	bench_shader_frame(scene, "mapped", mapped);
+}
+
+// N varyings of one kind summed by the fragment stage, isolates the interpolation cost
+template <int N, bool Perspective> class VaryingCostShader final : public IShader {
+private:
+	ShaderContext ctx_;
+public:
+	VaryingCostShader(const ShaderContext &ctx) : ctx_(ctx) {}
+	VaryingLayout layout() const override { return Perspective ? VaryingLayout{N, 0, 0} : VaryingLayout{0, N, 0}; }
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		Vec2f uv = ctx_.uv(iface, nthvert);
+		for (int k=0; k<N; k++) varyings[k] = uv.x*(k+1) + uv.y;
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		float s = 0;
+		for (int k=0; k<N; k++) s += varyings[k];
+		unsigned char c = (unsigned char)int(s*16.f);
+		color = TGAColor(c, c, c, 255);
+		return true;
+	}
+};
+
+template <int N, bool Perspective> static double varying_cost(BenchScene &scene, const ShaderContext &ctx) {
+	VaryingCostShader<N, Perspective> shader(ctx);
+	PrimitiveCuller culler(scene.width, scene.height);
+	std::vector<ShadedTriangle> tris;
+	assemble_shaded(scene.model, shader, culler, tris);
+	long fragments = 0;
+	double t = frame_seconds(scene, tris, shader, fragments);
+	return t/fragments*1e9;
+}
+
+// per-fragment cost of 0..16 varyings, perspective-correct and screen-linear, template path
+static void bench_varyings(BenchScene &scene) {
+	ThreadPool pool(1);
+	VertexProcessor vertices;
+	vertices.transform(scene.model, scene.MVP, pool);
+	ShaderContext ctx(scene.model, vertices, scene.light, scene.eye);
+	const int counts[6] = {0, 1, 2, 4, 8, 16};
+	double ns[2][6] = {
+		{varying_cost<0, true>(scene, ctx), varying_cost<1, true>(scene, ctx), varying_cost<2, true>(scene, ctx),
+		 varying_cost<4, true>(scene, ctx), varying_cost<8, true>(scene, ctx), varying_cost<16, true>(scene, ctx)},
+		{varying_cost<0, false>(scene, ctx), varying_cost<1, false>(scene, ctx), varying_cost<2, false>(scene, ctx),
+		 varying_cost<4, false>(scene, ctx), varying_cost<8, false>(scene, ctx), varying_cost<16, false>(scene, ctx)}
+	};
+	const char *kind[2] = {"perspective", "linear"};
+	for (int p=0; p<2; p++) {
+		for (int i=0; i<6; i++) {
+			std::cerr << "# bench varyings " << kind[p] << " " << counts[i] << ": " << ns[p][i] << " ns/fragment" << std::endl;
+		}
+		// least squares slope over the counts
+		double mx = 0, my = 0, sxy = 0, sxx = 0;
+		for (int i=0; i<6; i++) { mx += counts[i]/6.; my += ns[p][i]/6.; }
+		for (int i=0; i<6; i++) { sxy += (counts[i]-mx)*(ns[p][i]-my); sxx += (counts[i]-mx)*(counts[i]-mx); }
+		std::cerr << "# bench varyings " << kind[p] << " " << sxy/sxx << " ns per varying per fragment" << std::endl;
+	}
+}
+
+// the rendered frame as RGBA and as grayscale, to cover every encoder variant
+static TGAImage convert(TGAImage &img, int bpp) {
+	TGAImage out(img.get_width(), img.get_height(), bpp);
+	for (int y=0; y<img.get_height(); y++) {
+		for (int x=0; x<img.get_width(); x++) {
+			TGAColor c = img.get(x, y);
+			c.a = 255;
+			if (bpp==TGAImage::GRAYSCALE) c.b = (unsigned char)((c.r*77 + c.g*150 + c.b*29)>>8);
+			out.set(x, y, c);
+		}
+	}
+	return out;
+}
+
+static bool same_pixels(TGAImage &a, TGAImage &b) {
+	size_t n = size_t(a.get_width())*a.get_height()*a.get_bytespp();
+	return a.get_width()==b.get_width() && a.get_height()==b.get_height() && a.get_bytespp()==b.get_bytespp()
+	    && !memcmp(a.buffer(), b.buffer(), n);
+}
+
+// TGA encoding to memory on one thread and on the default pool, writing to a file, round trips
+static void bench_tga(BenchScene &scene) {
+	ThreadPool serial(1), pool(ThreadPool::default_threads());
+	VertexProcessor vertices;
+	vertices.transform(scene.model, scene.MVP, serial);
+	ShaderContext ctx(scene.model, vertices, scene.light, scene.eye);
+	TexturedShader shader(ctx);
+	PrimitiveCuller culler(scene.width, scene.height);
+	std::vector<ShadedTriangle> tris;
+	assemble_shaded(scene.model, shader, culler, tris);
+	TGAImage frame(scene.width, scene.height, TGAImage::RGB);
+	std::vector<float> zbuffer(scene.width*scene.height, -std::numeric_limits<float>::max());
+	render_shaded(tris, shader, frame, zbuffer.data(), (Tiler *)NULL, serial);
+
+	struct Case {
+		const char *name;
+		TGAImage img;
+	} cases[4] = {
+		{"frame rgb", frame},
+		{"frame rgba", convert(frame, TGAImage::RGBA)},
+		{"frame gray", convert(frame, TGAImage::GRAYSCALE)},
+		{"texture rgb", scene.model.diffuse_map()},
+	};
+	const char *tmpfile = "bench_tga.tmp";
+	for (Case &c : cases) {
+		double mb = double(c.img.get_width())*c.img.get_height()*c.img.get_bytespp()/1e6;
+		for (int rle=1; rle>=0; rle--) {
+			std::vector<unsigned char> out;
+			TGAWriter one(NULL), many(&pool);
+			double t1 = median_seconds([&]() { one.encode(c.img, out, rle); });
+			double tn = median_seconds([&]() { many.encode(c.img, out, rle); });
+			double tf = median_seconds([&]() { many.write(c.img, tmpfile, rle); });
+			TGAImage back;
+			bool ok = back.read_tga_file(tmpfile) && same_pixels(back, c.img);
+			std::cerr << "# bench tga " << c.name << (rle ? " rle" : " raw") << ": " << out.size() << " bytes, encode "
+			          << t1*1e3 << " ms (" << mb/t1 << " MB/s) on 1 thread, " << tn*1e3 << " ms on " << pool.size()
+			          << ", file " << tf*1e3 << " ms, round trip " << (ok ? "ok" : "FAILED") << std::endl;
+		}
+	}
+	std::remove(tmpfile);
+}
+
+// TGA decoding from files written by TGAWriter (top-left origin), read as is and bottom-up as
+// the texture loader does, plus the 4x upscaled texture for a working set well beyond the caches
+static void bench_tgaread(BenchScene &scene) {
+	TGAImage frame(scene.width, scene.height, TGAImage::RGB);
+	std::vector<float> zbuffer(scene.width*scene.height, -std::numeric_limits<float>::max());
+	{
+		ThreadPool serial(1);
+		VertexProcessor vertices;
+		vertices.transform(scene.model, scene.MVP, serial);
+		ShaderContext ctx(scene.model, vertices, scene.light, scene.eye);
+		TexturedShader shader(ctx);
+		PrimitiveCuller culler(scene.width, scene.height);
+		std::vector<ShadedTriangle> tris;
+		assemble_shaded(scene.model, shader, culler, tris);
+		render_shaded(tris, shader, frame, zbuffer.data(), (Tiler *)NULL, serial);
+	}
+	TGAImage big = scene.model.diffuse_map();
+	big.scale(big.get_width()*4, big.get_height()*4);
+	struct Case {
+		const char *name;
+		TGAImage img;
+	} cases[5] = {
+		{"frame rgb", frame},
+		{"frame rgba", convert(frame, TGAImage::RGBA)},
+		{"frame gray", convert(frame, TGAImage::GRAYSCALE)},
+		{"texture rgb", scene.model.diffuse_map()},
+		{"texture x4 rgb", big},
+	};
+	const char *tmpfile = "bench_tga.tmp";
+	TGAWriter writer(NULL);
+	// the decoder reports every file it reads, keep that out of the timings
+	std::streambuf *log = std::cerr.rdbuf(NULL);
+	for (Case &c : cases) {
+		double pixels = double(c.img.get_width())*c.img.get_height();
+		for (int rle=1; rle>=0; rle--) {
+			writer.write(c.img, tmpfile, rle);
+			std::FILE *f = std::fopen(tmpfile, "rb");
+			long bytes = 0;
+			if (f) {
+				std::fseek(f, 0, SEEK_END);
+				bytes = std::ftell(f);
+				std::fclose(f);
+			}
+			TGAImage back;
+			double td = median_seconds([&]() { back.read_tga_file(tmpfile); });
+			bool ok = same_pixels(back, c.img);
+			double tb = median_seconds([&]() { back.read_tga_file(tmpfile, true); });
+			back.flip_vertically();
+			ok = ok && same_pixels(back, c.img);
+			std::cerr.rdbuf(log);
+			std::cerr << "# bench tgaread " << c.name << (rle ? " rle" : " raw") << ": " << bytes << " bytes, decode "
+			          << td*1e3 << " ms (" << bytes/td/1e6 << " MB/s, " << pixels/td/1e6 << " Mpixels/s), bottom-up "
+			          << tb*1e3 << " ms, " << (ok ? "ok" : "FAILED") << std::endl;
+			std::cerr.rdbuf(NULL);
+		}
+	}
+	std::cerr.rdbuf(log);
+	std::remove(tmpfile);
+}
+
+// N independent RenderContexts on N threads sharing the model, each rendering an orbit of small
+// frames; every frame is compared with the one a lone context renders for the same pose
+static void bench_contexts(BenchScene &scene) {
+	const int FRAMES = 16;
+	RenderSettings settings;
+	settings.width = settings.height = 256;
+	settings.nthreads = 0;
+	CameraPose start = {Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0)};
+	std::vector<CameraPose> poses;
+	orbit_path("16", start, poses);
+	std::vector<TGAImage> expected;
+	{
+		RenderContext ref(scene.model, settings);
+		for (const CameraPose &p : poses) {
+			ref.render(p);
+			expected.push_back(ref.framebuffer());
+		}
+	}
+	int maxn = std::max(4, 2*ThreadPool::default_threads());
+	for (int n=1; n<=maxn; n*=2) {
+		std::vector<RenderContext *> contexts;
+		for (int i=0; i<n; i++) contexts.push_back(new RenderContext(scene.model, settings));
+		std::atomic<int> mismatches(0);
+		double t = median_seconds([&]() {
+			std::vector<std::thread> threads;
+			for (int i=0; i<n; i++) {
+				threads.push_back(std::thread([&, i]() {
+					RenderContext &ctx = *contexts[i];
+					for (int f=0; f<FRAMES; f++) {
+						int k = (f+i)%FRAMES; // contexts do not render the same pose at the same time
+						ctx.render(poses[k]);
+						if (!same_pixels(ctx.framebuffer(), expected[k])) mismatches++;
+					}
+				}));
+			}
+			for (std::thread &th : threads) th.join();
+		});
+		double renders = double(n)*FRAMES;
+		std::cerr << "# bench contexts " << n << ": " << renders/t << " renders/s, " << t/FRAMES*1e3
+		          << " ms/render per context, " << settings.width << "x" << settings.height << ", "
+		          << (mismatches ? "FAILED" : "identical to a single context") << std::endl;
+		for (RenderContext *c : contexts) delete c;
+	}
+}
+
+// The depth-only shadow pass against colour passes over the same view from the light (the fixed
+// textured path and TexturedShader), then the lit main pass without and with the shadow lookup;
+// all on one thread
+static void bench_shadow(BenchScene &scene) {
+	ThreadPool pool(1);
+	Vec3f light_dir = scene.light*-1.f;
+	int size = std::max(scene.width, scene.height);
+	ShadowMap shadow(size);
+	double td = median_seconds([&]() {
+		shadow.invalidate();
+		shadow.update(scene.model, light_dir, pool);
+	});
+	shadow.print_stats(std::cerr);
+
+	RenderSettings settings;
+	settings.width = settings.height = size;
+	settings.nthreads = 0;
+	settings.winding = CULL_NONE;
+	RenderContext fixed(scene.model, settings);
+	double tf = median_seconds([&]() { fixed.render(shadow.transform(), scene.light, scene.light, fixed.framebuffer()); });
+	settings.shader = SHADER_TEXTURED;
+	RenderContext textured(scene.model, settings);
+	double tt = median_seconds([&]() { textured.render(shadow.transform(), scene.light, scene.light, textured.framebuffer()); });
+	std::cerr << "# bench shadow " << size << "x" << size << " from the light: depth only " << td*1e3 << " ms, fixed textured "
+	          << tf*1e3 << " ms (" << tf/td << "x), textured shader " << tt*1e3 << " ms (" << tt/td << "x)" << std::endl;
+
+	settings = RenderSettings();
+	settings.width = scene.width;
+	settings.height = scene.height;
+	settings.nthreads = 0;
+	settings.shader = SHADER_PHONG;
+	settings.light_dir = light_dir;
+	RenderContext lit(scene.model, settings);
+	double tl = median_seconds([&]() { lit.render(scene.MVP, scene.light, scene.eye, lit.framebuffer()); });
+	settings.shadow_size = size;
+	RenderContext shadowed(scene.model, settings);
+	shadowed.render(scene.MVP, scene.light, scene.eye, shadowed.framebuffer()); // renders the map once
+	double ts = median_seconds([&]() { shadowed.render(scene.MVP, scene.light, scene.eye, shadowed.framebuffer()); });
+	std::cerr << "# bench shadow phong frame " << tl*1e3 << " ms, with " << 2*SHADOW_PCF_RADIUS+1 << "x"
+	          << 2*SHADOW_PCF_RADIUS+1 << " PCF shadows " << ts*1e3 << " ms (map reused), "
+	          << (td+ts)*1e3 << " ms with the shadow pass" << std::endl;
+}
+
+// forward against deferred phong frames, with and without back-face culling (which removes
+// most of the overdraw of a closed mesh), on one thread and on the default pool
+static void bench_deferred(BenchScene &scene) {
+	const CullWinding windings[2] = {CULL_CW, CULL_NONE};
+	const int threads[2] = {0, ThreadPool::default_threads()};
+	for (CullWinding w : windings) {
+		for (int t : threads) {
+			RenderSettings settings;
+			settings.width = scene.width;
+			settings.height = scene.height;
+			settings.nthreads = t;
+			settings.winding = w;
+			settings.shader = SHADER_PHONG;
+			RenderContext forward(scene.model, settings);
+			settings.deferred = true;
+			RenderContext deferred(scene.model, settings);
+			double tf = median_seconds([&]() { forward.render(scene.MVP, scene.light, scene.eye, forward.framebuffer()); });
+			double td = median_seconds([&]() { deferred.render(scene.MVP, scene.light, scene.eye, deferred.framebuffer()); });
+			bool same = same_pixels(forward.framebuffer(), deferred.framebuffer());
+			std::cerr << "# bench deferred phong, cull " << (w==CULL_NONE ? "none" : "cw") << ", " << t << " threads: forward "
+			          << tf*1e3 << " ms, deferred " << td*1e3 << " ms, fragments shaded " << deferred.gbuffer().written
+			          << " forward, " << deferred.gbuffer().shaded << " deferred, " << (same ? "same image" : "IMAGES DIFFER") << std::endl;
+		}
+	}
+}
+
+// the ambient occlusion pass against the frame it darkens, for the fixed path and phong, on one
+// thread and on the default pool
+static void bench_ssao(BenchScene &scene) {
+	const ShaderKind shaders[2] = {SHADER_NONE, SHADER_PHONG};
+	const int threads[2] = {1, ThreadPool::default_threads()};
+	for (ShaderKind s : shaders) {
+		for (int t : threads) {
+			RenderSettings settings;
+			settings.width = scene.width;
+			settings.height = scene.height;
+			settings.nthreads = t;
+			settings.shader = s;
+			RenderContext ctx(scene.model, settings);
+			double tr = median_seconds([&]() { ctx.render(scene.MVP, scene.light, scene.eye, ctx.framebuffer()); });
+			AmbientOcclusion ao(scene.width, scene.height);
+			TGAImage image = ctx.framebuffer();
+			double ta = median_seconds([&]() { ao.apply(ctx.depth(), image, ctx.pool()); });
+			std::cerr << "# bench ssao " << (s==SHADER_NONE ? "fixed" : "phong") << ", " << t << " threads, "
+			          << scene.width << "x" << scene.height << ": frame " << tr*1e3 << " ms, ssao " << ta*1e3
+			          << " ms (" << ta/tr*100 << "% of the frame)" << std::endl;
+		}
+	}
+}
+
+// peak signal to noise ratio of a against b in dB, same size and format
+static double psnr(TGAImage &a, TGAImage &b) {
+	size_t n = size_t(a.get_width())*a.get_height()*a.get_bytespp();
+	double se = 0;
+	for (size_t i=0; i<n; i++) {
+		double d = double(a.buffer()[i])-b.buffer()[i];
+		se += d*d;
+	}
+	return se ? 10*std::log10(255.*255.*n/se) : std::numeric_limits<double>::infinity();
+}
+
+// anti-aliasing of the textured frame: single sampled, 4x MSAA and 2x2 supersampling with its
+// box resolve, time and the bytes of the buffers each keeps, the quality as PSNR against SSAA
+static void bench_msaa(BenchScene &scene) {
+	RenderSettings settings;
+	settings.width = scene.width;
+	settings.height = scene.height;
+	settings.shader = SHADER_TEXTURED;
+	RenderContext plain(scene.model, settings);
+	settings.msaa = true;
+	RenderContext msaa(scene.model, settings);
+	settings.msaa = false;
+	settings.width = 2*scene.width;
+	settings.height = 2*scene.height;
+	RenderContext large(scene.model, settings);
+	// the screen space of the frame scaled into the large one, as supersampled_viewport() does
+	Matrix scale = Matrix::identity(4);
+	scale[0][0] = scale[1][1] = 2;
+	scale[0][3] = scale[1][3] = .5f;
+	mat4 MVP = mat4(scale)*scene.MVP;
+	TGAImage ssaa(scene.width, scene.height, plain.framebuffer().get_bytespp());
+	double tp = median_seconds([&]() { plain.render(scene.MVP, scene.light, scene.eye, plain.framebuffer()); });
+	double tm = median_seconds([&]() { msaa.render(scene.MVP, scene.light, scene.eye, msaa.framebuffer()); });
+	double ts = median_seconds([&]() {
+		large.render(MVP, scene.light, scene.eye, large.framebuffer());
+		downsample_box(large.framebuffer(), ssaa, 2, large.pool());
+	});
+	size_t pixels = size_t(scene.width)*scene.height, bpp = ssaa.get_bytespp();
+	size_t single = pixels*(bpp+sizeof(float));
+	struct { const char *name; double seconds; size_t bytes; TGAImage *image; } rows[3] = {
+		{"off", tp, single, &plain.framebuffer()},
+		{"4x", tm, single + msaa.msaa().bytes(), &msaa.framebuffer()},
+		{"ssaa 2x2", ts, 4*single + pixels*bpp, &ssaa},
+	};
+	for (int i=0; i<3; i++) {
+		std::cerr << "# bench msaa " << rows[i].name << ", " << scene.width << "x" << scene.height << ": " << rows[i].seconds*1e3
+		          << " ms (" << rows[i].seconds/tp << "x), " << rows[i].bytes/1048576.
+		          << " MiB of buffers, " << psnr(*rows[i].image, ssaa) << " dB against ssaa" << std::endl;
+	}
+}
+
+struct Benchmark {
+	const char *name;
+	void (*run)(BenchScene &scene);
+};
+
+static const Benchmark benchmarks[] = {
+	{"sampler",  bench_sampler},
+	{"shader",   bench_shader},
+	{"varyings", bench_varyings},
+	{"tga",      bench_tga},
+	{"tgaread",  bench_tgaread},
+	{"contexts", bench_contexts},
+	{"shadow",   bench_shadow},
+	{"deferred", bench_deferred},
+	{"ssao",     bench_ssao},
+	{"msaa",     bench_msaa},
+};
+
+bool run_benchmark(const char *name, BenchScene &scene, const BenchOptions &options) {
+	std::string n(name);
+	if (n=="suite") return run_suite(scene, options);
+	bool found = false;
+	for (const Benchmark &b : benchmarks) {
+		if (n!="all" && n!=b.name) continue;
+		b.run(scene);
+		found = true;
+	}
+	if (!found) {
+		std::cerr << "unknown benchmark " << name << ", available:";
+		for (const Benchmark &b : benchmarks) std::cerr << " " << b.name;
+		std::cerr << " all suite\n";
+	}
+	return found;
+}
@@ -0,0 +1,34 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "geometry.h"
+#include "model.h"
+
+// what main renders, for the benchmarks that need a frame
+struct BenchScene {
+	Model &model;
+	mat4 MVP;
+	int width, height;
+	Vec3f light; // unit vector towards the light, model space
+	Vec3f eye;   // unit vector towards the viewer, model space
+	const char *obj; // the file the model was loaded from
+};
+
+// for -bench suite: save writes the results as a baseline, baseline compares with a saved one
+struct BenchOptions {
+	const char *save;
+	const char *baseline;
+	float threshold; // relative slowdown of the best run or of the median counted as a regression
+};
+
+// Micro benchmarks selected with -bench <name> ("all" runs every one of them). Results go to
+// std::cerr as "# bench" lines; false if the name is unknown or the suite found a regression.
+bool run_benchmark(const char *name, BenchScene &scene, const BenchOptions &options);
+
+// The regression suite ("suite"): fill rate, matrix products, model loading, TGA encoding and
+// decoding, texture sampling and full frames at several resolutions, each with its best, median
+// and slowest of 7 to 31 runs and, in the bench binary of make bench, its allocation count (see
+// alloc_count.h). False when a regression against the baseline was found.
+bool run_suite(BenchScene &scene, const BenchOptions &options);
+
+#endif //__BENCH_H__
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <atomic>
+#include <algorithm>
+#include "bench.h"
+#include "alloc_count.h"
+#include "rasterizer.h"
+#include "renderer.h"
+#include "tga_writer.h"
+#include "texture.h"
+
+// main is linked without alloc_count.cpp, the suite then reports no allocation counts
+__attribute__((weak)) bool allocations_counted() { return false; }
+__attribute__((weak)) void count_allocations(bool) {}
+__attribute__((weak)) long allocation_count() { return 0; }
+
+static volatile float suite_sink;
+
+struct SuiteResult {
+	std::string name;
+	const char *unit;
+	double best, median, max; // seconds per unit
+	double allocs;      // per run, -1 when not counted
+};
+
+// runs f() once to warm up, then runs times; items units of work per run
+template <class F> static SuiteResult measure(const char *name, int runs, double items, const char *unit, F f) {
+	f();
+	std::vector<double> t;
+	long allocated = 0;
+	count_allocations(true);
+	for (int r=0; r<runs; r++) {
+		long before = allocation_count();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		f();
+		double s = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+		allocated += allocation_count()-before;
+		t.push_back(s/items);
+	}
+	count_allocations(false);
+	std::sort(t.begin(), t.end());
+	SuiteResult res;
+	res.name   = name;
+	res.unit   = unit;
+	res.best   = t[0];
+	res.median = t[t.size()/2];
+	res.max    = t.back();
+	res.allocs = allocations_counted() ? double(allocated)/runs : -1;
+	return res;
+}
+
+static std::string duration(double seconds) {
+	char buf[64];
+	if (seconds<1e-6) snprintf(buf, sizeof(buf), "%.3g ns", seconds*1e9);
+	else if (seconds<1e-3) snprintf(buf, sizeof(buf), "%.3g us", seconds*1e6);
+	else snprintf(buf, sizeof(buf), "%.3g ms", seconds*1e3);
+	return buf;
+}
+
+static void add(std::vector<SuiteResult> &results, const SuiteResult &r) {
+	std::cerr << "# bench suite " << r.name << ": median " << duration(r.median) << "/" << r.unit << ", max "
+	          << duration(r.max) << "/" << r.unit;
+	if (r.allocs>=0) std::cerr << ", " << r.allocs << " allocs/run";
+	std::cerr << std::endl;
+	results.push_back(r);
+}
+
+// pseudo-random triangles covering a size x size screen, about 1/8 of it each
+static std::vector<ScreenTriangle> fill_triangles(int size, int n) {
+	std::vector<ScreenTriangle> tris(n);
+	unsigned seed = 12345;
+	for (ScreenTriangle &t : tris) {
+		for (int j=0; j<3; j++) {
+			seed = seed*1664525u+1013904223u;
+			float x = (seed>>8)%size, y = (seed>>20)%size;
+			t.pts[j]  = Vec3f(x, y, float(seed%255));
+			t.uvs[j] = Vec2f(x/size, y/size);
+			t.invw[j] = 1;
+		}
+	}
+	return tris;
+}
+
+static double covered_pixels(const std::vector<ScreenTriangle> &tris) {
+	double area = 0;
+	for (const ScreenTriangle &t : tris) {
+		area += std::abs((t.pts[1].x-t.pts[0].x)*(t.pts[2].y-t.pts[0].y)-(t.pts[2].x-t.pts[0].x)*(t.pts[1].y-t.pts[0].y))/2;
+	}
+	return area;
+}
+
+static void suite(BenchScene &scene, std::vector<SuiteResult> &results) {
+	// barycentric() alone, then whole triangles through the legacy and the SIMD rasterizer
+	{
+		Vec3i pts[3] = {Vec3i(10, 10, 0), Vec3i(500, 40, 0), Vec3i(200, 480, 0)};
+		add(results, measure("barycentric", 31, 512*512, "call", [&]() {
+			float s = 0;
+			for (int y=0; y<512; y++)
+				for (int x=0; x<512; x++) s += barycentric(pts, Vec3f(x, y, 0)).x;
+			suite_sink = s;
+		}));
+	}
+	{
+		const int size = 512;
+		std::vector<ScreenTriangle> tris = fill_triangles(size, 64);
+		TGAImage image(size, size, TGAImage::RGB);
+		std::vector<float> zbuffer(size*size);
+		double pixels = covered_pixels(tris);
+		const char *names[2] = {"fill bary", "fill simd"};
+		RasterMode modes[2] = {RASTER_BARYCENTRIC, RASTER_SIMD};
+		for (int m=0; m<2; m++) {
+			add(results, measure(names[m], 15, pixels, "pixel", [&]() {
+				std::fill(zbuffer.begin(), zbuffer.end(), -std::numeric_limits<float>::max());
+				for (const ScreenTriangle &t : tris) {
+					rasterize(t, modes[m], image, zbuffer.data(), scene.model, Vec2i(0, 0), Vec2i(size-1, size-1));
+				}
+			}));
+		}
+	}
+	// matrix products, the compatibility Matrix and mat4
+	{
+		Matrix a = lookat(Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0)), b = viewport(0, 0, 800, 800);
+		add(results, measure("Matrix::operator*", 31, 10000, "product", [&]() {
+			Matrix c = a;
+			for (int i=0; i<10000; i++) c = b*c, c[3][3] = 1;
+			suite_sink = c[0][0];
+		}));
+		mat4 a4 = a, b4 = b;
+		add(results, measure("mat4 product", 31, 10000, "product", [&]() {
+			mat4 c = a4;
+			for (int i=0; i<10000; i++) c = b4*c, c[3][3] = 1;
+			suite_sink = c[0][0];
+		}));
+	}
+	// loading the bundled model without its cache: OBJ parsing, texture decoding, mip building
+	{
+		std::streambuf *log = std::cerr.rdbuf(NULL);
+		SuiteResult r = measure("model load", 7, 1, "load", [&]() {
+			Model m(scene.obj, false);
+			suite_sink = m.nverts();
+		});
+		std::cerr.rdbuf(log);
+		add(results, r);
+	}
+	// TGA encoding of the texture, decoding of the file
+	{
+		TGAImage &tex = scene.model.diffuse_map();
+		double pixels = double(tex.get_width())*tex.get_height();
+		TGAWriter writer(NULL);
+		std::vector<unsigned char> out;
+		add(results, measure("tga encode", 15, pixels, "pixel", [&]() { writer.encode(tex, out); }));
+		const char *tmpfile = "bench_suite.tmp";
+		writer.write(tex, tmpfile);
+		TGAImage back;
+		std::streambuf *log = std::cerr.rdbuf(NULL);
+		SuiteResult r = measure("tga decode", 15, pixels, "pixel", [&]() { back.read_tga_file(tmpfile); });
+		std::cerr.rdbuf(log);
+		add(results, r);
+		std::remove(tmpfile);
+	}
+	// texture sampling at random points
+	{
+		const Texture &tex = scene.model.diffuse_texture();
+		std::vector<float> uvl(3*65536);
+		unsigned seed = 1;
+		for (float &f : uvl) {
+			seed = seed*1664525u+1013904223u;
+			f = (seed>>8)/float(1<<24);
+		}
+		const char *names[2] = {"sample bilinear", "sample trilinear"};
+		TextureFilter filters[2] = {FILTER_BILINEAR, FILTER_TRILINEAR};
+		for (int k=0; k<2; k++) {
+			add(results, measure(names[k], 15, 65536, "sample", [&]() {
+				uint32_t s = 0;
+				for (int i=0; i<65536; i++) s += tex.sample(uvl[3*i], uvl[3*i+1], uvl[3*i+2]*tex.nlevels(), filters[k]);
+				suite_sink = s;
+			}));
+		}
+	}
+	// full frames of the bundled model through the default pipeline
+	{
+		CameraPose pose = {Vec3f(1, 1, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0)};
+		const int sizes[4] = {256, 512, 800, 1600};
+		for (int size : sizes) {
+			RenderSettings settings;
+			settings.width = settings.height = size;
+			RenderContext ctx(scene.model, settings);
+			std::string name = "frame " + std::to_string(size);
+			add(results, measure(name.c_str(), 15, 1, "frame", [&]() { ctx.render(pose); }));
+		}
+	}
+}
+
+// "name<TAB>best_ns<TAB>median_ns<TAB>max_ns<TAB>allocs" per line
+static bool save_baseline(const char *filename, const std::vector<SuiteResult> &results) {
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		std::cerr << "can't write benchmark baseline " << filename << "\n";
+		return false;
+	}
+	for (const SuiteResult &r : results) {
+		out << r.name << "\t" << r.best*1e9 << "\t" << r.median*1e9 << "\t" << r.max*1e9 << "\t" << r.allocs << "\n";
+	}
+	std::cerr << "# bench suite baseline saved to " << filename << std::endl;
+	return true;
+}
+
+// Slower than the baseline by more than threshold, or more allocations, is a regression. Both the
+// best run and the median are compared: noise from the rest of the machine only ever adds to a
+// run, so the best one is the stable measure of the code's speed, while the median catches a
+// change that only slows down some of the runs.
+static bool compare_baseline(const char *filename, const std::vector<SuiteResult> &results, float threshold) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		std::cerr << "can't open benchmark baseline " << filename << "\n";
+		return false;
+	}
+	std::map<std::string, SuiteResult> baseline;
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t tab = line.find('\t');
+		if (tab==std::string::npos) continue;
+		SuiteResult r;
+		r.name = line.substr(0, tab);
+		std::istringstream iss(line.substr(tab+1));
+		if (!(iss >> r.best >> r.median >> r.max >> r.allocs)) continue;
+		baseline[r.name] = r;
+	}
+	int regressions = 0;
+	for (const SuiteResult &r : results) {
+		std::map<std::string, SuiteResult>::const_iterator b = baseline.find(r.name);
+		if (b==baseline.end()) {
+			std::cerr << "# bench suite " << r.name << ": not in the baseline" << std::endl;
+			continue;
+		}
+		double change = r.best*1e9/b->second.best-1, median = r.median*1e9/b->second.median-1;
+		bool slower = change>threshold || median>threshold;
+		bool allocs = r.allocs>=0 && b->second.allocs>=0 && r.allocs>b->second.allocs+.5;
+		regressions += slower || allocs;
+		std::cerr << "# bench suite " << r.name << ": best " << (change>=0 ? "+" : "") << change*100 << "%, median "
+		          << (median>=0 ? "+" : "") << median*100 << "% vs baseline";
+		if (allocs) std::cerr << ", allocs " << b->second.allocs << " -> " << r.allocs;
+		std::cerr << ((slower || allocs) ? ", REGRESSION" : ", ok") << std::endl;
+	}
+	std::cerr << "# bench suite " << regressions << " regressions beyond " << threshold*100 << "%" << std::endl;
+	return regressions==0;
+}
+
+bool run_suite(BenchScene &scene, const BenchOptions &options) {
+	std::vector<SuiteResult> results;
+	suite(scene, results);
+	bool ok = true;
+	if (options.save) ok = save_baseline(options.save, results) && ok;
+	if (options.baseline) ok = compare_baseline(options.baseline, results, options.threshold) && ok;
+	return ok;
+}
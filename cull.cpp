@@ -0,0 +1,163 @@
+#include <algorithm>
+#include "cull.h"
+#include "profile.h"
+
+// signed distances to the clipping planes, a vertex is inside when d>=0
+static inline float dist_near(const vec4 &h, float near_w, int, int) { return h[3]-near_w; }
+static inline float dist_left(const vec4 &h, float, int, int) { return h[0]+GUARD_BAND*h[3]; }
+static inline float dist_right(const vec4 &h, float, int w, int) { return (w+GUARD_BAND)*h[3]-h[0]; }
+static inline float dist_bottom(const vec4 &h, float, int, int) { return h[1]+GUARD_BAND*h[3]; }
+static inline float dist_top(const vec4 &h, float, int, int h_) { return (h_+GUARD_BAND)*h[3]-h[1]; }
+
+typedef float (*PlaneDistance)(const vec4 &, float, int, int);
+
+// Sutherland-Hodgman against a single plane, out receives at most n+1 vertices
+static int clip_polygon(const ClipVertex *in, int n, int nvaryings, ClipVertex *out, PlaneDistance dist, float near_w, int width, int height) {
+    int m = 0;
+    for (int i=0; i<n; i++) {
+        const ClipVertex &a = in[i], &b = in[(i+1)%n];
+        float da = dist(a.h, near_w, width, height), db = dist(b.h, near_w, width, height);
+        if (da>=0) out[m++] = a;
+        if ((da>=0) != (db>=0)) {
+            float t = da/(da-db);
+            out[m].h = a.h + (b.h-a.h)*t;
+            for (int k=0; k<nvaryings; k++) {
+                out[m].varyings[k] = a.varyings[k] + (b.varyings[k]-a.varyings[k])*t;
+            }
+            m++;
+        }
+    }
+    return m;
+}
+
+PrimitiveCuller::PrimitiveCuller(int width, int height) : width_(width), height_(height), winding_(CULL_CW), near_w_(1e-2f) {
+    stats_ = CullStats();
+}
+
+void PrimitiveCuller::set_near(float w) {
+    near_w_ = w;
+}
+
+void PrimitiveCuller::set_winding(CullWinding winding) {
+    winding_ = winding;
+}
+
+CullResult PrimitiveCuller::classify(const vec4 h[3]) {
+    stats_.in++;
+    int outside[5] = {0, 0, 0, 0, 0}; // vertices beyond left, right, bottom, top, near
+    bool guard = false;
+    for (int j=0; j<3; j++) {
+        const vec4 &c = h[j];
+        outside[0] += c[0] < -c[3];
+        outside[1] += c[0] > width_*c[3];
+        outside[2] += c[1] < -c[3];
+        outside[3] += c[1] > height_*c[3];
+        outside[4] += c[3] < near_w_;
+        guard = guard || c[0] < -GUARD_BAND*c[3] || c[0] > (width_+GUARD_BAND)*c[3]
+                      || c[1] < -GUARD_BAND*c[3] || c[1] > (height_+GUARD_BAND)*c[3];
+    }
+    if (outside[0]==3 || outside[1]==3 || outside[2]==3 || outside[3]==3 || outside[4]==3) {
+        stats_.culled_frustum++;
+        return PRIM_CULLED;
+    }
+    if (winding_!=CULL_NONE) {
+        // det[x y w] = w0*w1*w2 * screen space signed area, valid for vertices behind the eye too
+        float det = h[0][0]*(h[1][1]*h[2][3]-h[2][1]*h[1][3])
+                  - h[1][0]*(h[0][1]*h[2][3]-h[2][1]*h[0][3])
+                  + h[2][0]*(h[0][1]*h[1][3]-h[1][1]*h[0][3]);
+        if (det==0 || (winding_==CULL_CW) == (det<0)) {
+            stats_.culled_backface++;
+            return PRIM_CULLED;
+        }
+    }
+    if (outside[4]) {
+        stats_.clipped_near++;
+        return PRIM_CLIPPED;
+    }
+    if (guard) {
+        stats_.clipped_guard++;
+        return PRIM_CLIPPED;
+    }
+    return PRIM_INSIDE;
+}
+
+int PrimitiveCuller::clip(const vec4 h[3], const float *const varyings[3], int nvaryings, ClipVertex poly[MAX_CLIP_VERTS]) {
+    ClipVertex tmp[MAX_CLIP_VERTS];
+    for (int j=0; j<3; j++) {
+        tmp[j].h = h[j];
+        for (int k=0; k<nvaryings; k++) tmp[j].varyings[k] = varyings[j][k];
+    }
+    // ping-pong between tmp and poly, an odd number of planes leaves the result in poly
+    PlaneDistance planes[5] = {dist_near, dist_left, dist_right, dist_bottom, dist_top};
+    ClipVertex *in = tmp, *out = poly;
+    int n = 3;
+    for (int p=0; p<5 && n>=3; p++) {
+        n = clip_polygon(in, n, nvaryings, out, planes[p], near_w_, width_, height_);
+        std::swap(in, out);
+    }
+    if (n<3) return 0;
+    if (in!=poly) std::copy(in, in+n, poly);
+    return n;
+}
+
+void PrimitiveCuller::count_out(long ntris) {
+    stats_.out += ntris;
+    profile_count(COUNT_TRIANGLES_IN, stats_.in);
+    profile_count(COUNT_TRIANGLES_CULLED, stats_.culled_backface+stats_.culled_frustum);
+}
+
+void PrimitiveCuller::reset_stats() {
+    stats_ = CullStats();
+}
+
+void PrimitiveCuller::assemble(Model &model, VertexProcessor &vertices, std::vector<ScreenTriangle> &tris) {
+    PROFILE_SCOPE("primitive assembly");
+    int nfaces = model.nfaces();
+    const int *vidx = model.facet_verts(), *tidx = model.facet_uvs();
+    const float *u = model.uv_component(0), *v = model.uv_component(1);
+    reset_stats();
+    tris.clear();
+    tris.reserve(nfaces);
+    ClipVertex poly[MAX_CLIP_VERTS];
+    for (int i=0; i<nfaces; i++) {
+        vec4 h[3];
+        for (int j=0; j<3; j++) h[j] = vertices.clip(vidx[i*3+j]);
+        CullResult r = classify(h);
+        if (r==PRIM_CULLED) continue;
+        ScreenTriangle t;
+        for (int j=0; j<3; j++) {
+            int k = tidx[i*3+j];
+            t.uvs[j] = k<0 ? Vec2f(0, 0) : Vec2f(u[k], v[k]);
+            t.invw[j] = 1.f/h[j][3];
+        }
+        if (r==PRIM_INSIDE) {
+            // inside the guard band the projected vertices are used as they are
+            for (int j=0; j<3; j++) t.pts[j] = vertices.screen(vidx[i*3+j]);
+            tris.push_back(t);
+            continue;
+        }
+        const float *uvs[3] = {t.uvs[0].raw, t.uvs[1].raw, t.uvs[2].raw};
+        int n = clip(h, uvs, 2, poly);
+        for (int k=1; k+1<n; k++) {
+            const ClipVertex *c[3] = {&poly[0], &poly[k], &poly[k+1]};
+            for (int j=0; j<3; j++) {
+                t.pts[j] = Vec3f(c[j]->h[0]/c[j]->h[3], c[j]->h[1]/c[j]->h[3], c[j]->h[2]/c[j]->h[3]);
+                t.uvs[j] = Vec2f(c[j]->varyings[0], c[j]->varyings[1]);
+                t.invw[j] = 1.f/c[j]->h[3];
+            }
+            tris.push_back(t);
+        }
+    }
+    count_out(tris.size());
+    vertices.count_references(3*(long)nfaces);
+}
+
+const CullStats &PrimitiveCuller::stats() const {
+    return stats_;
+}
+
+void PrimitiveCuller::print_stats(std::ostream &s) const {
+    s << "# cull in " << stats_.in << ", backface " << stats_.culled_backface << ", frustum " << stats_.culled_frustum
+      << ", near clipped " << stats_.clipped_near << ", guard band clipped " << stats_.clipped_guard
+      << ", out " << stats_.out << std::endl;
+}
@@ -0,0 +1,74 @@
+#ifndef __CULL_H__
+#define __CULL_H__
+
+#include <vector>
+#include <iostream>
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "vertex.h"
+
+// which screen-space winding (y up) is treated as back-facing and dropped
+enum CullWinding {
+	CULL_NONE,
+	CULL_CW,
+	CULL_CCW
+};
+
+// Pixels the fixed-point rasterizers can address beyond each screen edge. Triangles reaching
+// further out are clipped against this band; everything inside it is passed through unclipped
+// and left to the bounding box clamp of the rasterizer.
+const float GUARD_BAND = 2048.f;
+
+enum CullResult {
+	PRIM_CULLED,  // back-facing or outside the frustum
+	PRIM_INSIDE,  // within the guard band, to be rasterized as is
+	PRIM_CLIPPED  // crosses the near plane or the guard band, see PrimitiveCuller::clip
+};
+
+// a polygon clipped against up to 5 planes from a triangle has at most 3+5 corners
+const int MAX_CLIP_VERTS = 8;
+
+struct ClipVertex {
+	vec4 h;
+	float varyings[MAX_VARYINGS];
+};
+
+struct CullStats {
+	long in;
+	long culled_backface;
+	long culled_frustum;
+	long clipped_near;
+	long clipped_guard;
+	long out;
+};
+
+// Primitive assembly between the vertex stage and the rasterizer: back-face culling, trivial
+// frustum rejection and clipping in homogeneous coordinates (the viewport matrix is affine, so
+// clipping after it is equivalent to clipping in clip space).
+class PrimitiveCuller {
+private:
+	int width_, height_;
+	CullWinding winding_;
+	float near_w_;
+	CullStats stats_;
+public:
+	PrimitiveCuller(int width, int height);
+	// w of the near plane: with the viewer looking down -z, w is proportional to the distance to the eye
+	void set_near(float w);
+	void set_winding(CullWinding winding);
+	// the textured fast path: faces of model, positions from the vertex stage, uvs as the only varyings
+	void assemble(Model &model, VertexProcessor &vertices, std::vector<ScreenTriangle> &tris);
+	// building blocks for other primitive assemblers, counters are kept up to date by classify
+	// and count_out; reset_stats starts a new frame
+	CullResult classify(const vec4 h[3]);
+	// near plane and guard band clipping, nvaryings floats per corner are interpolated along;
+	// returns the number of polygon corners written to poly (0 or 3..MAX_CLIP_VERTS)
+	int clip(const vec4 h[3], const float *const varyings[3], int nvaryings, ClipVertex poly[MAX_CLIP_VERTS]);
+	void count_out(long ntris);
+	void reset_stats();
+	const CullStats &stats() const;
+	void print_stats(std::ostream &s) const;
+};
+
+#endif //__CULL_H__
@@ -7,13 +7,34 @@
 template <> template <> Vec3<int>::Vec3<>(const Vec3<float> &v) : x(int(v.x+.5)), y(int(v.y+.5)), z(int(v.z+.5)) {}
 template <> template <> Vec3<float>::Vec3<>(const Vec3<int> &v) : x(v.x), y(v.y), z(v.z) {}
 
-Matrix::Matrix(Vec3f v) : m(std::vector<std::vector<float> >(4, std::vector<float>(1, 1.f))), rows(4), cols(1) {
+Matrix::Matrix(Vec3f v) : rows(4), cols(1) {
     m[0][0] = v.x;
     m[1][0] = v.y;
     m[2][0] = v.z;
+    m[3][0] = 1.f;
 }
 
-Matrix::Matrix(int r, int c) : m(std::vector<std::vector<float> >(r, std::vector<float>(c, 0.f))), rows(r), cols(c) { }
+Matrix::Matrix(int r, int c) : rows(r), cols(c) {
+    assert(r>0 && c>0 && r<=DEFAULT_ALLOC && c<=DEFAULT_ALLOC);
+    for (int i=0; i<r; i++)
+        for (int j=0; j<c; j++)
+            m[i][j] = 0.f;
+}
+
+Matrix::Matrix(const mat4 &a) : rows(4), cols(4) {
+    for (int i=0; i<4; i++)
+        for (int j=0; j<4; j++)
+            m[i][j] = a[i][j];
+}
+
+Matrix::operator mat4() const {
+    assert(rows==4 && cols==4);
+    mat4 a;
+    for (int i=0; i<4; i++)
+        for (int j=0; j<4; j++)
+            a[i][j] = m[i][j];
+    return a;
+}
 
 int Matrix::nrows() {
     return rows;
@@ -33,7 +54,7 @@ Matrix Matrix::identity(int dimensions) {
     return E;
 }
 
-std::vector<float>& Matrix::operator[](const int i) {
+float* Matrix::operator[](const int i) {
     assert(i>=0 && i<rows);
     return m[i];
 }
@@ -43,10 +64,11 @@ Matrix Matrix::operator*(const Matrix& a) {
     Matrix result(rows, a.cols);
     for (int i=0; i<rows; i++) {
         for (int j=0; j<a.cols; j++) {
-            result.m[i][j] = 0.f;
+            float s = 0.f;
             for (int k=0; k<cols; k++) {
-                result.m[i][j] += m[i][k]*a.m[k][j];
+                s += m[i][k]*a.m[k][j];
             }
+            result.m[i][j] = s;
         }
     }
     return result;
@@ -63,32 +85,31 @@ Matrix Matrix::transpose() {
 Matrix Matrix::inverse() {
     assert(rows==cols);
     // augmenting the square matrix with the identity matrix of the same dimensions a => [ai]
-    Matrix result(rows, cols*2);
-    for(int i=0; i<rows; i++)
-        for(int j=0; j<cols; j++)
-            result[i][j] = m[i][j];
+    float result[DEFAULT_ALLOC][DEFAULT_ALLOC*2];
+    int rcols = cols*2;
     for(int i=0; i<rows; i++)
-        result[i][i+cols] = 1;
+        for(int j=0; j<rcols; j++)
+            result[i][j] = j<cols ? m[i][j] : (j-cols==i ? 1.f : 0.f);
     // first pass
     for (int i=0; i<rows-1; i++) {
         // normalize the first row
-        for(int j=result.cols-1; j>=0; j--)
+        for(int j=rcols-1; j>=0; j--)
             result[i][j] /= result[i][i];
         for (int k=i+1; k<rows; k++) {
             float coeff = result[k][i];
-            for (int j=0; j<result.cols; j++) {
+            for (int j=0; j<rcols; j++) {
                 result[k][j] -= result[i][j]*coeff;
             }
         }
     }
     // normalize the last row
-    for(int j=result.cols-1; j>=rows-1; j--)
+    for(int j=rcols-1; j>=rows-1; j--)
         result[rows-1][j] /= result[rows-1][rows-1];
     // second pass
     for (int i=rows-1; i>0; i--) {
         for (int k=i-1; k>=0; k--) {
             float coeff = result[k][i];
-            for (int j=0; j<result.cols; j++) {
+            for (int j=0; j<rcols; j++) {
                 result[k][j] -= result[i][j]*coeff;
             }
         }
@@ -2,6 +2,8 @@
 #define __GEOMETRY_H__
 
 #include <cmath>
+#include <vector>
+#include <iostream>
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -66,18 +68,146 @@ template <class t> std::ostream& operator<<(std::ostream& s, Vec3<t>& v) {
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 
+// fixed-size vectors and matrices, no heap allocation; everything is usable in constant expressions
+
+template <int n> struct vec {
+	float data[n] = {};
+	constexpr float& operator[](const int i)       { return data[i]; }
+	constexpr float  operator[](const int i) const { return data[i]; }
+};
+
+template <int n> constexpr vec<n> operator+(const vec<n> &a, const vec<n> &b) {
+	vec<n> r;
+	for (int i=0; i<n; i++) r[i] = a[i]+b[i];
+	return r;
+}
+
+template <int n> constexpr vec<n> operator-(const vec<n> &a, const vec<n> &b) {
+	vec<n> r;
+	for (int i=0; i<n; i++) r[i] = a[i]-b[i];
+	return r;
+}
+
+template <int n> constexpr vec<n> operator*(const vec<n> &a, float f) {
+	vec<n> r;
+	for (int i=0; i<n; i++) r[i] = a[i]*f;
+	return r;
+}
+
+template <int n> constexpr vec<n> operator/(const vec<n> &a, float f) {
+	vec<n> r;
+	for (int i=0; i<n; i++) r[i] = a[i]/f;
+	return r;
+}
+
+template <int n> constexpr float operator*(const vec<n> &a, const vec<n> &b) {
+	float r = 0;
+	for (int i=0; i<n; i++) r += a[i]*b[i];
+	return r;
+}
+
+template <int nrows, int ncols> struct mat {
+	vec<ncols> rows[nrows] = {};
+	constexpr vec<ncols>& operator[](const int i)       { return rows[i]; }
+	constexpr const vec<ncols>& operator[](const int i) const { return rows[i]; }
+
+	constexpr vec<nrows> col(const int j) const {
+		vec<nrows> r;
+		for (int i=0; i<nrows; i++) r[i] = rows[i][j];
+		return r;
+	}
+
+	constexpr mat<ncols, nrows> transpose() const {
+		mat<ncols, nrows> r;
+		for (int i=0; i<nrows; i++)
+			for (int j=0; j<ncols; j++)
+				r[j][i] = rows[i][j];
+		return r;
+	}
+
+	static constexpr mat<nrows, ncols> identity() {
+		mat<nrows, ncols> r;
+		for (int i=0; i<nrows && i<ncols; i++) r[i][i] = 1.f;
+		return r;
+	}
+
+	// Gauss-Jordan elimination with partial pivoting, square matrices only
+	constexpr mat<nrows, ncols> inverse() const {
+		static_assert(nrows==ncols, "only square matrices can be inverted");
+		mat<nrows, ncols> a = *this;
+		mat<nrows, ncols> r = identity();
+		for (int i=0; i<nrows; i++) {
+			int pivot = i;
+			for (int k=i+1; k<nrows; k++)
+				if ((a[k][i]<0 ? -a[k][i] : a[k][i]) > (a[pivot][i]<0 ? -a[pivot][i] : a[pivot][i])) pivot = k;
+			vec<ncols> t = a[i]; a[i] = a[pivot]; a[pivot] = t;
+			t = r[i]; r[i] = r[pivot]; r[pivot] = t;
+			float d = a[i][i];
+			a[i] = a[i]/d;
+			r[i] = r[i]/d;
+			for (int k=0; k<nrows; k++) {
+				if (k==i) continue;
+				float coeff = a[k][i];
+				a[k] = a[k] - a[i]*coeff;
+				r[k] = r[k] - r[i]*coeff;
+			}
+		}
+		return r;
+	}
+};
+
+template <int nrows, int ncols> constexpr vec<nrows> operator*(const mat<nrows, ncols> &m, const vec<ncols> &v) {
+	vec<nrows> r;
+	for (int i=0; i<nrows; i++) r[i] = m[i]*v;
+	return r;
+}
+
+// same summation order as Matrix::operator*, so results do not depend on which type is used
+template <int r1, int c1, int c2> constexpr mat<r1, c2> operator*(const mat<r1, c1> &a, const mat<c1, c2> &b) {
+	mat<r1, c2> result;
+	for (int i=0; i<r1; i++) {
+		for (int j=0; j<c2; j++) {
+			float s = 0.f;
+			for (int k=0; k<c1; k++) s += a[i][k]*b[k][j];
+			result[i][j] = s;
+		}
+	}
+	return result;
+}
+
+typedef vec<2>    vec2;
+typedef vec<3>    vec3;
+typedef vec<4>    vec4;
+typedef mat<3, 3> mat3;
+typedef mat<4, 4> mat4;
+
+inline vec4 embed(const Vec3f &v, float w=1.f) {
+	vec4 r;
+	r[0] = v.x; r[1] = v.y; r[2] = v.z; r[3] = w;
+	return r;
+}
+
+inline Vec3f proj3(const vec4 &v) {
+	return Vec3f(v[0], v[1], v[2]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
 const int DEFAULT_ALLOC=4;
 
+// Thin compatibility layer over fixed storage: at most DEFAULT_ALLOC rows and columns.
 class Matrix {
-	std::vector<std::vector<float> > m;
+	float m[DEFAULT_ALLOC][DEFAULT_ALLOC];
 	int rows, cols;
 public:
 	Matrix(int r=DEFAULT_ALLOC, int c=DEFAULT_ALLOC);
 	Matrix(Vec3f v);
+	Matrix(const mat4 &a);
+	operator mat4() const;
 	inline int nrows();
 	inline int ncols();
 	static Matrix identity(int dimensions);
-	std::vector<float>& operator[](const int i);
+	float* operator[](const int i);
 	Matrix operator*(const Matrix& a);
 	Matrix transpose();
 	Matrix inverse();
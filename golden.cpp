@@ -0,0 +1,130 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "golden.h"
+#include "profile.h"
+
+// a reference image of tga/ and how it was rendered: looking at the origin from eye, y up
+struct GoldenScene {
+	const char *name;
+	ShaderKind shader;
+	Vec3f eye;
+	bool perspective;    // the tutorial's -1/eye.z projection, otherwise orthographic
+	float max_outliers;  // this scene's limits for the default pipeline, see below
+	float min_psnr;
+};
+
+// The references are the tutorial's own renders and are never regenerated: they differ from
+// this renderer by the fill convention and the texture sampling along every edge, so each scene
+// has its own limits, set 0.3% of the pixels and 1 dB beyond what `./main -check` measures
+// with the default pipeline at tolerance 8. After an intended change of the output, run
+// `make check`, read the psnr and the fraction of each scene from its "# check" line and move
+// its limits here by the same margin; a new scene gets its reference from the <name>.out.tga
+// that a failed check writes. The other images of tga/ come from tutorial stages this renderer
+// no longer has (wireframes, random colours, unshaded triangles) and are not checked.
+static const GoldenScene golden_scenes[] = {
+	{"african-head-diagonal",            SHADER_NONE, Vec3f(1, 1, 3), true,  .0265f, 37.4f}, // 2.348%, 38.38 dB
+	{"african-head-projection",          SHADER_NONE, Vec3f(0, 0, 3), true,  .0175f, 38.2f}, // 1.438%, 39.25 dB
+	{"african-head-orthogonal-render",   SHADER_NONE, Vec3f(0, 0, 1), false, .0212f, 37.5f}, // 1.815%, 38.51 dB
+	{"african-head-front-light-zbuffer", SHADER_FLAT, Vec3f(0, 0, 1), false, .0157f, 30.0f}, // 1.265%, 31.06 dB
+};
+
+struct GoldenDiff {
+	long outliers;       // pixels beyond the tolerance
+	int max_diff;
+	double psnr;         // infinite when identical
+};
+
+// both images of the same size and format, rows in the same order
+static GoldenDiff compare(TGAImage &image, TGAImage &reference, int tolerance, TGAImage *diff) {
+	int bpp = image.get_bytespp();
+	long npixels = long(image.get_width())*image.get_height();
+	const unsigned char *a = image.buffer(), *b = reference.buffer();
+	unsigned char *d = diff ? diff->buffer() : NULL;
+	GoldenDiff res = {0, 0, 0};
+	double sse = 0;
+	for (long i=0; i<npixels; i++) {
+		int worst = 0;
+		for (int c=0; c<bpp; c++) {
+			int e = std::abs(int(a[i*bpp+c])-int(b[i*bpp+c]));
+			sse += e*e;
+			if (e>worst) worst = e;
+		}
+		if (worst>res.max_diff) res.max_diff = worst;
+		bool outlier = worst>tolerance;
+		res.outliers += outlier;
+		if (d) {
+			for (int c=0; c<bpp; c++) d[i*bpp+c] = outlier ? (c==2 || bpp==1 ? 255 : 0) : b[i*bpp+c]/4;
+		}
+	}
+	double mse = sse/(double(npixels)*bpp);
+	res.psnr = mse>0 ? 10*std::log10(255.*255./mse) : INFINITY;
+	return res;
+}
+
+static bool check_scene(Model &model, const RenderSettings &base, const GoldenScene &scene, const GoldenOptions &options) {
+	std::string path = std::string(options.dir) + "/" + scene.name + ".tga";
+	TGAImage reference;
+	std::streambuf *log = std::cerr.rdbuf(NULL); // the reader's own messages
+	bool loaded = reference.read_tga_file(path.c_str(), true); // bottom up as the framebuffer
+	std::cerr.rdbuf(log);
+	if (!loaded) {
+		std::cerr << "# check " << scene.name << ": can't read " << path << std::endl;
+		return false;
+	}
+
+	RenderSettings settings = base;
+	settings.width  = reference.get_width();
+	settings.height = reference.get_height();
+	settings.shader = scene.shader;
+	RenderContext ctx(model, settings);
+	CameraPose pose = {scene.eye, Vec3f(0, 0, 0), Vec3f(0, 1, 0)};
+	Matrix Projection = Matrix::identity(4);
+	if (scene.perspective) Projection[3][2] = -1.f/scene.eye.z;
+	mat4 MVP = mat4(viewport(0, 0, settings.width, settings.height))*mat4(Projection)*mat4(lookat(pose.eye, pose.center, pose.up));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ctx.render(MVP, settings.light_dir*-1.f, (pose.eye-pose.center).normalize(), ctx.framebuffer());
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+
+	TGAImage &image = ctx.framebuffer();
+	if (image.get_bytespp()!=reference.get_bytespp()) {
+		std::cerr << "# check " << scene.name << ": reference has " << reference.get_bytespp()
+		          << " bytes per pixel, the render " << image.get_bytespp() << std::endl;
+		return false;
+	}
+	TGAImage diff(image.get_width(), image.get_height(), image.get_bytespp());
+	GoldenDiff d = compare(image, reference, options.tolerance, &diff);
+	double outliers = double(d.outliers)/(double(image.get_width())*image.get_height());
+	float max_outliers = options.max_outliers<0 ? scene.max_outliers : options.max_outliers;
+	float min_psnr = options.min_psnr<0 ? scene.min_psnr : options.min_psnr;
+	bool ok = outliers<=max_outliers && d.psnr>=min_psnr;
+
+	char line[320];
+	snprintf(line, sizeof(line), "# check %-34s %s: psnr %.2f dB (min %.1f), %ld pixels beyond %d (%.3f%%, max %.2f%%), max diff %d, render %.1f ms",
+	         scene.name, ok ? "ok" : "FAILED", d.psnr, min_psnr, d.outliers, options.tolerance, outliers*100, max_outliers*100, d.max_diff, elapsed);
+	std::cerr << line << std::endl;
+	if (!ok) {
+		std::string out = std::string(scene.name) + ".out.tga", dfile = std::string(scene.name) + ".diff.tga";
+		image.flip_vertically(); // the origin at the left bottom corner, as main writes it
+		diff.flip_vertically();
+		image.write_tga_file(out.c_str());
+		diff.write_tga_file(dfile.c_str());
+		std::cerr << "# check " << scene.name << ": render written to " << out << ", diff to " << dfile << std::endl;
+	}
+	return ok;
+}
+
+bool run_golden_checks(Model &model, const RenderSettings &settings, const GoldenOptions &options) {
+	PROFILE_SCOPE("golden checks");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int failed = 0, n = sizeof(golden_scenes)/sizeof(golden_scenes[0]);
+	for (int i=0; i<n; i++) {
+		failed += !check_scene(model, settings, golden_scenes[i], options);
+	}
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+	std::cerr << "# check " << n-failed << " of " << n << " scenes passed in " << elapsed << " ms" << std::endl;
+	return failed==0;
+}
@@ -0,0 +1,23 @@
+#ifndef __GOLDEN_H__
+#define __GOLDEN_H__
+
+#include "model.h"
+#include "renderer.h"
+
+// for -check: where the reference images are and how close a render has to be
+struct GoldenOptions {
+	const char *dir;     // the reference images, tga/
+	int tolerance;       // largest channel difference of a pixel still counted as equal
+	float max_outliers;  // fraction of the pixels allowed beyond the tolerance, <0 for each scene's own
+	float min_psnr;      // dB over the whole image, <0 for each scene's own
+};
+
+// Golden image checks: renders every reference scene of dir that this renderer can reproduce
+// with the given settings (rasterizer, threads, hiz, culling) and compares it with the file.
+// A scene fails beyond the outlier fraction or below the PSNR, by default the limits golden.cpp
+// keeps for each scene (and documents how to move them); its render is written as
+// <name>.out.tga and a diff image as <name>.diff.tga (the reference dimmed, failing pixels in
+// red) in the current directory. One "# check" line per scene to std::cerr, false on failure.
+bool run_golden_checks(Model &model, const RenderSettings &settings, const GoldenOptions &options);
+
+#endif //__GOLDEN_H__
@@ -0,0 +1,120 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include "hiz.h"
+
+HiZBuffer::HiZBuffer(int width, int height) : width_(0), height_(0), zmin_(),
+    tris_tested_(0), tris_culled_(0), tiles_tested_(0), tiles_culled_(0) {
+    resize(width, height);
+}
+
+void HiZBuffer::resize(int width, int height) {
+    width_  = width;
+    height_ = height;
+    ntx_ = (width +HIZ_TILE-1)/HIZ_TILE;
+    nty_ = (height+HIZ_TILE-1)/HIZ_TILE;
+    zmin_.assign(ntx_*nty_, 0.f);
+    dirty_.assign(ntx_*nty_, 0);
+}
+
+void HiZBuffer::clear(float z) {
+    std::fill(zmin_.begin(), zmin_.end(), z);
+    std::fill(dirty_.begin(), dirty_.end(), 0);
+}
+
+bool HiZBuffer::rejects(int tx, int ty, float zmax, const float *zbuffer) {
+    int i = tx+ty*ntx_;
+    if (zmax<=zmin_[i]) return true;
+    if (!dirty_[i]) return false;
+    update(tx, ty, zbuffer);
+    return zmax<=zmin_[i];
+}
+
+void HiZBuffer::mark(int tx, int ty) {
+    dirty_[tx+ty*ntx_] = 1;
+}
+
+void HiZBuffer::update(int tx, int ty, const float *zbuffer) {
+    int x1 = std::min((tx+1)*HIZ_TILE, width_);
+    int y1 = std::min((ty+1)*HIZ_TILE, height_);
+    float z = zbuffer[tx*HIZ_TILE+ty*HIZ_TILE*width_];
+    for (int y=ty*HIZ_TILE; y<y1; y++) {
+        const float *row = zbuffer+y*width_;
+        for (int x=tx*HIZ_TILE; x<x1; x++) {
+            z = std::min(z, row[x]);
+        }
+    }
+    zmin_[tx+ty*ntx_] = z;
+    dirty_[tx+ty*ntx_] = 0;
+}
+
+void HiZBuffer::count(long tiles_tested, long tiles_culled) {
+    tris_tested_++;
+    if (tiles_tested==tiles_culled) tris_culled_++;
+    tiles_tested_ += tiles_tested;
+    tiles_culled_ += tiles_culled;
+}
+
+void HiZBuffer::reset_stats() {
+    tris_tested_ = tris_culled_ = tiles_tested_ = tiles_culled_ = 0;
+}
+
+void HiZBuffer::print_stats(std::ostream &s) const {
+    s << "# hiz triangles culled " << tris_culled_ << "/" << tris_tested_
+      << ", tiles culled " << tiles_culled_ << "/" << tiles_tested_ << std::endl;
+}
+
+// Upper bound of the depth any raster mode can produce for t. The barycentric path works on
+// rounded depths and accepts weights down to -.001, the margin covers both plus float rounding.
+static float depth_bound(const ScreenTriangle &t) {
+    float zmin = t.pts[0].z, zmax = t.pts[0].z;
+    for (int i=0; i<3; i++) {
+        float zr = float(int(t.pts[i].z+.5));
+        zmin = std::min(zmin, std::min(t.pts[i].z, zr));
+        zmax = std::max(zmax, std::max(t.pts[i].z, zr));
+    }
+    return zmax + .01f*(zmax-zmin) + 1e-3f*(std::abs(zmax)+1.f);
+}
+
+void rasterize_hiz(const ScreenTriangle &t, RasterMode mode, TGAImage &image, float *zbuffer, HiZBuffer &hiz, Model &model, Vec2i clipmin, Vec2i clipmax) {
+    Vec2i bboxmin, bboxmax;
+    bounding_box(t, bboxmin, bboxmax);
+    bboxmin = Vec2i(std::max(bboxmin.x, clipmin.x), std::max(bboxmin.y, clipmin.y));
+    bboxmax = Vec2i(std::min(bboxmax.x, clipmax.x), std::min(bboxmax.y, clipmax.y));
+    if (bboxmin.x>bboxmax.x || bboxmin.y>bboxmax.y) return;
+    float zmax = depth_bound(t);
+    int tx0 = bboxmin.x/HIZ_TILE, tx1 = bboxmax.x/HIZ_TILE;
+    int ty0 = bboxmin.y/HIZ_TILE, ty1 = bboxmax.y/HIZ_TILE;
+    long tested = 0, culled = 0;
+    for (int ty=ty0; ty<=ty1; ty++) {
+        for (int tx=tx0; tx<=tx1; tx++) {
+            tested++;
+            if (hiz.rejects(tx, ty, zmax, zbuffer)) culled++;
+        }
+    }
+    hiz.count(tested, culled);
+    if (culled==tested) return;
+    if (culled==0) {
+        rasterize(t, mode, image, zbuffer, model, bboxmin, bboxmax);
+        for (int ty=ty0; ty<=ty1; ty++)
+            for (int tx=tx0; tx<=tx1; tx++)
+                hiz.mark(tx, ty);
+        return;
+    }
+    for (int ty=ty0; ty<=ty1; ty++) {
+        // consecutive surviving tiles of a row are rasterized as one rectangle
+        int run = -1;
+        for (int tx=tx0; tx<=tx1+1; tx++) {
+            bool visible = tx<=tx1 && !hiz.rejects(tx, ty, zmax, zbuffer);
+            if (visible && run<0) run = tx;
+            if (visible || run<0) continue;
+            Vec2i rectmin(std::max(run*HIZ_TILE, bboxmin.x), std::max(ty*HIZ_TILE, bboxmin.y));
+            Vec2i rectmax(std::min(tx*HIZ_TILE-1, bboxmax.x), std::min((ty+1)*HIZ_TILE-1, bboxmax.y));
+            rasterize(t, mode, image, zbuffer, model, rectmin, rectmax);
+            for (int k=run; k<tx; k++) {
+                hiz.mark(k, ty);
+            }
+            run = -1;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __HIZ_H__
+#define __HIZ_H__
+
+#include <vector>
+#include <atomic>
+#include "rasterizer.h"
+
+const int HIZ_TILE = 8;
+
+// Coarse depth for 8x8 pixel tiles. A fragment is kept when zbuffer<z, so the smallest
+// (farthest) depth of a tile is the conservative bound: a triangle whose nearest point does not
+// exceed it cannot pass the z-test anywhere in that tile. Depths only grow, so a stale bound is
+// still conservative; written tiles are just marked and refreshed when a test needs them.
+class HiZBuffer {
+private:
+	int width_, height_;
+	int ntx_, nty_;
+	std::vector<float> zmin_;
+	std::vector<unsigned char> dirty_;
+	std::atomic<long> tris_tested_, tris_culled_;
+	std::atomic<long> tiles_tested_, tiles_culled_;
+public:
+	HiZBuffer(int width, int height);
+	// new screen size, the bounds must be cleared again
+	void resize(int width, int height);
+	void clear(float z);
+	bool rejects(int tx, int ty, float zmax, const float *zbuffer);
+	void mark(int tx, int ty);
+	// recomputes the bound of a tile from the full resolution zbuffer
+	void update(int tx, int ty, const float *zbuffer);
+	// triangles are counted per call, i.e. once per bin when the tiler splits them
+	void count(long tiles_tested, long tiles_culled);
+	void reset_stats();
+	void print_stats(std::ostream &s) const;
+};
+
+// rasterize() restricted to the 8x8 tiles the HiZBuffer cannot reject, keeps the buffer up to date
+void rasterize_hiz(const ScreenTriangle &t, RasterMode mode, TGAImage &image, float *zbuffer, HiZBuffer &hiz, Model &model, Vec2i clipmin, Vec2i clipmax);
+
+#endif //__HIZ_H__
@@ -1,68 +1,30 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
-#include <limits>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
 #include "tgaimage.h"
 #include "model.h"
 #include "geometry.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+#include "texture.h"
+#include "bench.h"
+#include "tga_writer.h"
+#include "batch.h"
+#include "renderer.h"
+#include "profile.h"
+#include "golden.h"
+#include "msaa.h"
 
 const TGAColor white = TGAColor(255, 255, 255, 255);
 const TGAColor red   = TGAColor(255, 0,   0,   255);
 const TGAColor green = TGAColor(0, 	 255, 0,   255);
 const TGAColor blue  = TGAColor(0, 	 0,   255, 255);
 
-const int width  = 800;
-const int height = 800;
-const int depth  = 255;
-
-Model *model = new Model("obj/african_head.obj");
-float *zbuffer = new float[width*height];
-Vec3f light_dir(0,0,-1);
-Vec3f eye(1,1,3);
-Vec3f center(0,0,0);
-Vec3f up(0,1,0);
-Matrix ModelView;
-
-Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
-    Vec3f z = (eye-center).normalize();
-    Vec3f x = cross(up,z).normalize();
-    Vec3f y = cross(z,x).normalize();
-    Matrix Minv = Matrix::identity(4);
-    Matrix Tr = Matrix::identity(4);
-    for (int i=0; i<3; i++) {
-        Minv[0][i] = x[i];
-        Minv[1][i] = y[i];
-        Minv[2][i] = z[i];
-        Tr[i][3] = -center[i];
-    }
-    return Minv*Tr;
-}
-
-Matrix viewport(int x, int y, int w, int h) {
-    Matrix m = Matrix::identity(4);
-    m[0][3] = x+w/2.f;
-    m[1][3] = y+h/2.f;
-    m[2][3] = depth/2.f;
-
-    m[0][0] = w/2.f;
-    m[1][1] = h/2.f;
-    m[2][2] = depth/2.f;
-    return m;
-}
-
-Vec3f m2v(Matrix m) {
-    return Vec3f(m[0][0]/m[3][0], m[1][0]/m[3][0], m[2][0]/m[3][0]);
-}
-
-Matrix v2m(Vec3f v) {
-    Matrix m(4, 1);
-    m[0][0] = v.x;
-    m[1][0] = v.y;
-    m[2][0] = v.z;
-    m[3][0] = 1.f;
-    return m;
-}
-
 void line(int x0, int y0, int x1, int y1, TGAImage &image, TGAColor color) {
 	bool steep;
 	if (std::abs(x0-x1)<std::abs(y0-y1)) { // if the line is steep, we transpose the image
@@ -97,92 +59,250 @@ void line(Vec2i t0, Vec2i t1, TGAImage &image, TGAColor color) {
 	line(t0.x, t0.y, t1.x, t1.y, image, color);
 }
 
-Vec3f barycentric(Vec3i pts[3], Vec3f P) {
-	// S = <up, vp, s>
-	Vec3f S =
-		Vec3f(pts[2].x - pts[0].x,
-			  pts[1].x - pts[0].x,
-			  pts[0].x - P.x) ^
-		Vec3f(pts[2].y - pts[0].y,
-			  pts[1].y - pts[0].y,
-			  pts[0].y - P.y);
-	double up, vp, s, u, v;
-	up = S.x; vp = S.y; s = S.z;
-	// P = (1-u-v)*A + v*B + u*C
-	u = up / s; v = vp / s;
-	if (std::abs(s) > .01) {
-		// due to floating point precision: 1.-(up+vp)/s != 1.-u-v
-		return Vec3f(1.-u-v, v, u);
-	}
-	// degenerate case
-	return Vec3f(-1,-1,-1);
+static void write_output(TGAImage &image, ThreadPool &pool) {
+	image.flip_vertically(); // i want to have the origin at the left bottom corner of the image
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TGAWriter writer(&pool);
+	writer.write(image, "output.tga");
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+	std::cerr << "# tga write " << elapsed << " ms" << std::endl;
 }
 
-void triangle(Vec3i pts[3], Vec2f uvs[3], TGAImage &image, float *zbuffer) {
-    Vec2i bboxmin( std::numeric_limits<int>::max(),  std::numeric_limits<int>::max());
-    Vec2i bboxmax(-std::numeric_limits<int>::max(), -std::numeric_limits<int>::max());
-	Vec2i clamp(image.get_width()-1,image.get_height()-1);
-	for (int i=0; i<3; i++) {
-		for (int j=0; j<2; j++) {
-			bboxmin[j] = std::max(0, 		std::min(bboxmin[j], pts[i][j]));
-			bboxmax[j] = std::min(clamp[j], std::max(bboxmax[j], pts[i][j]));
-		}
+// with -profile: the Chrome trace and the summary table of the whole run
+static int finish(const char *trace, int status) {
+	if (trace) {
+		profile_enable(false);
+		profile_write_trace(trace);
+		profile_print_summary(std::cerr);
 	}
-	// P in ABC iff u,v,(1-u-v) \in [0,1]
-	Vec3f P;
-	for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
-		for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
-			Vec3f bc_screen = barycentric(pts, P);
-			// leniancy for floating point error
-			float err = -.001;
-			if (bc_screen.x<err || bc_screen.y<err || bc_screen.z<err) continue;
-			P.z = 0;
-			Vec2f uvP(0,0);
-			for (int i=0; i<3; i++) {
-				P.z += pts[i].z*bc_screen[i];
-				uvP.x += uvs[i].x*bc_screen[i];
-				uvP.y += uvs[i].y*bc_screen[i];
-			}
-			if (zbuffer[int(P.x+P.y*width)]<P.z) {
-				zbuffer[int(P.x+P.y*width)] = P.z;
-				TGAColor color = model->diffuse(uvP);
-				image.set(P.x, P.y, color);
-			}
-		}
+	return status;
+}
+
+// Renders every pose into a numbered file (pattern as for printf, e.g. frame%04d.tga). The model
+// and all buffers are shared by the frames; each frame is written while the next one renders.
+static void render_batch(const std::vector<CameraPose> &poses, const char *pattern, RenderContext &ctx) {
+	const RenderSettings &s = ctx.settings();
+	FrameWriter writer(s.width, s.height, TGAImage::RGB);
+	Vec3f light = s.light_dir*-1.f;
+	double raster_ms = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i=0; i<(int)poses.size(); i++) {
+		std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+		Vec3f view = (poses[i].eye-poses[i].center).normalize();
+		ctx.render(ctx.camera_matrix(poses[i]), light, view, writer.image());
+		raster_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-frame_start).count();
+		char filename[1024];
+		snprintf(filename, sizeof(filename), pattern, i);
+		writer.submit(filename, frame_start);
 	}
+	writer.finish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	std::vector<double> latency = writer.latencies();
+	std::sort(latency.begin(), latency.end());
+	int n = (int)latency.size();
+	std::cerr << "# batch " << n << " frames in " << seconds*1e3 << " ms, " << n/seconds << " frames/s, render "
+	          << raster_ms/n << " ms/frame, write " << writer.write_ms()/n << " ms/frame" << std::endl;
+	std::cerr << "# batch frame latency median " << latency[n/2] << " ms, p95 " << latency[std::min(n-1, n*95/100)]
+	          << " ms, max " << latency[n-1] << " ms" << std::endl;
+	if (s.shader==SHADER_NONE && s.use_hiz) ctx.hiz().print_stats(std::cerr);
 }
 
 int main(int argc, char** argv) {
-	for (int i=0; i<width*height; i++) {
-		zbuffer[i] = -std::numeric_limits<float>::max();
+	// -t 0 runs the plain serial face loop, -t N the binned rasterizer on N threads
+	// -r bary|edge|simd picks the rasterizer, -hiz 0 turns off the hierarchical z rejection
+	// -cache 0 always parses the OBJ instead of using (and refreshing) its binary cache
+	// -shader flat|gouraud|textured|phong|mapped renders through the programmable pipeline instead
+	// -bench suite runs the regression suite, -save file stores its results as the baseline,
+	// -baseline file compares with one and fails beyond -threshold percent (15)
+	// -profile trace.json records per-stage timings and counters, see profile.h
+	// -shadow size renders -shader phong (the default with it) or mapped with a shadow map of size^2 texels,
+	// -light x,y,z sets the direction the light travels (0,0,-1)
+	// -deferred 1 shades once per visible pixel after a G-buffer pass (with -shader only)
+	// -ssao 1 darkens the frame by screen-space ambient occlusion from its depth buffer
+	// -aa msaa renders with 4x multisampling (through the shaders, so the texture is point-sampled
+	// and -filter is ignored), -aa ssaa at 2x2 the resolution, box filtered down
+	// -check [dir] compares the reference scenes of tga/ with the selected pipeline, failing beyond
+	// -tolerance (per channel), -outliers percent of the pixels or under -psnr dB, by default the
+	// limits of each scene, see golden.cpp
+	// -cameras file or -orbit frames[,radius[,height]] renders a batch of views to -o frame%04d.tga
+	int nthreads = ThreadPool::default_threads();
+	RasterMode mode = RASTER_SIMD;
+	bool use_hiz = true;
+	bool use_cache = true;
+	CullWinding winding = CULL_CW;
+	TextureFilter filter = FILTER_POINT;
+	const char *bench = NULL;
+	BenchOptions bench_options = {NULL, NULL, .15f};
+	ShaderKind shader = SHADER_NONE;
+	bool shader_set = false;
+	int shadow_size = 0;
+	bool deferred = false;
+	bool ssao = false;
+	bool msaa = false;
+	int ssaa = 1;
+	Vec3f light_dir(0, 0, -1);
+	Vec3f eye(1,1,3);
+	Vec3f center(0,0,0);
+	Vec3f up(0,1,0);
+	std::vector<CameraPose> poses;
+	const char *out_pattern = "frame%04d.tga";
+	const char *trace = NULL;
+	bool batch_ok = true;
+	bool check = false;
+	GoldenOptions check_options = {"tga", 8, -1.f, -1.f};
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-t") && i+1<argc) nthreads = std::max(0, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-r") && i+1<argc) {
+			i++;
+			if (!strcmp(argv[i], "bary")) mode = RASTER_BARYCENTRIC;
+			else if (!strcmp(argv[i], "edge")) mode = RASTER_EDGE;
+			else if (!strcmp(argv[i], "simd")) mode = RASTER_SIMD;
+			else std::cerr << "unknown raster mode " << argv[i] << "\n";
+		} else if (!strcmp(argv[i], "-cache") && i+1<argc) {
+			use_cache = atoi(argv[++i])!=0;
+		} else if (!strcmp(argv[i], "-hiz") && i+1<argc) {
+			use_hiz = atoi(argv[++i])!=0;
+		} else if (!strcmp(argv[i], "-cull") && i+1<argc) {
+			i++;
+			if (!strcmp(argv[i], "none")) winding = CULL_NONE;
+			else if (!strcmp(argv[i], "cw")) winding = CULL_CW;
+			else if (!strcmp(argv[i], "ccw")) winding = CULL_CCW;
+			else std::cerr << "unknown cull winding " << argv[i] << "\n";
+		} else if (!strcmp(argv[i], "-filter") && i+1<argc) {
+			i++;
+			if (!strcmp(argv[i], "point")) filter = FILTER_POINT;
+			else if (!strcmp(argv[i], "nearest")) filter = FILTER_NEAREST;
+			else if (!strcmp(argv[i], "bilinear")) filter = FILTER_BILINEAR;
+			else if (!strcmp(argv[i], "trilinear")) filter = FILTER_TRILINEAR;
+			else std::cerr << "unknown texture filter " << argv[i] << "\n";
+		} else if (!strcmp(argv[i], "-shader") && i+1<argc) {
+			i++;
+			if (!strcmp(argv[i], "none")) shader = SHADER_NONE;
+			else if (!strcmp(argv[i], "flat")) shader = SHADER_FLAT;
+			else if (!strcmp(argv[i], "gouraud")) shader = SHADER_GOURAUD;
+			else if (!strcmp(argv[i], "textured")) shader = SHADER_TEXTURED;
+			else if (!strcmp(argv[i], "phong")) shader = SHADER_PHONG;
+			else if (!strcmp(argv[i], "mapped")) shader = SHADER_MAPPED;
+			else std::cerr << "unknown shader " << argv[i] << "\n";
+			shader_set = true;
+		} else if (!strcmp(argv[i], "-shadow") && i+1<argc) {
+			shadow_size = std::max(0, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-deferred") && i+1<argc) {
+			deferred = atoi(argv[++i])!=0;
+		} else if (!strcmp(argv[i], "-ssao") && i+1<argc) {
+			ssao = atoi(argv[++i])!=0;
+		} else if (!strcmp(argv[i], "-aa") && i+1<argc) {
+			i++;
+			if (!strcmp(argv[i], "none")) { msaa = false; ssaa = 1; }
+			else if (!strcmp(argv[i], "msaa")) { msaa = true; ssaa = 1; }
+			else if (!strcmp(argv[i], "ssaa")) { msaa = false; ssaa = 2; }
+			else std::cerr << "unknown anti-aliasing " << argv[i] << "\n";
+		} else if (!strcmp(argv[i], "-light") && i+1<argc) {
+			Vec3f l;
+			if (sscanf(argv[++i], "%f,%f,%f", &l.x, &l.y, &l.z)==3 && l.norm()>0) light_dir = l.normalize();
+			else std::cerr << "bad light direction " << argv[i] << ", expected x,y,z\n";
+		} else if (!strcmp(argv[i], "-cameras") && i+1<argc) {
+			batch_ok = read_camera_path(argv[++i], poses) && batch_ok;
+		} else if (!strcmp(argv[i], "-orbit") && i+1<argc) {
+			CameraPose start = {eye, center, up};
+			batch_ok = orbit_path(argv[++i], start, poses) && batch_ok;
+		} else if (!strcmp(argv[i], "-profile") && i+1<argc) {
+			trace = argv[++i];
+		} else if (!strcmp(argv[i], "-check")) {
+			check = true;
+			if (i+1<argc && argv[i+1][0]!='-') check_options.dir = argv[++i];
+		} else if (!strcmp(argv[i], "-tolerance") && i+1<argc) {
+			check_options.tolerance = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-outliers") && i+1<argc) {
+			check_options.max_outliers = atof(argv[++i])/100.f;
+		} else if (!strcmp(argv[i], "-psnr") && i+1<argc) {
+			check_options.min_psnr = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-o") && i+1<argc) {
+			out_pattern = argv[++i];
+		} else if (!strcmp(argv[i], "-bench") && i+1<argc) {
+			bench = argv[++i];
+		} else if (!strcmp(argv[i], "-save") && i+1<argc) {
+			bench_options.save = argv[++i];
+		} else if (!strcmp(argv[i], "-baseline") && i+1<argc) {
+			bench_options.baseline = argv[++i];
+		} else if (!strcmp(argv[i], "-threshold") && i+1<argc) {
+			bench_options.threshold = atof(argv[++i])/100.f;
+		} else if (!strcmp(argv[i], "-simd") && i+1<argc) {
+			i++;
+			if (!set_simd_kernel(argv[i])) std::cerr << "simd kernel " << argv[i] << " is not available\n";
+		}
 	}
 
+	if (!batch_ok || (!poses.empty() && !frame_pattern(out_pattern))) return 1;
+	if (shadow_size && !shader_set) shader = SHADER_PHONG;
+	if (shadow_size && shader!=SHADER_PHONG && shader!=SHADER_MAPPED) std::cerr << "# shadows are only cast with -shader phong or mapped\n";
+	if (deferred && shader==SHADER_NONE) std::cerr << "# the deferred mode needs -shader, rendering forward\n";
+	if (deferred && msaa) std::cerr << "# -aa msaa renders forward, -deferred is ignored\n";
+	if (msaa && filter!=FILTER_POINT) std::cerr << "# -aa msaa samples the texture with points, -filter is ignored\n";
+	if (ssaa>1 && !poses.empty()) std::cerr << "# -aa ssaa renders single frames, the batch is not supersampled\n";
+	if (trace) profile_enable(true);
+
+	const char *obj = "obj/african_head.obj";
+	Model model(obj, use_cache);
+	model.set_texture_filter(filter);
+	RenderSettings settings;
+	settings.nthreads    = nthreads;
+	settings.mode        = mode;
+	settings.use_hiz     = use_hiz;
+	settings.winding     = winding;
+	settings.shader      = shader;
+	settings.light_dir   = light_dir;
+	settings.shadow_size = shadow_size;
+	settings.deferred    = deferred;
+	settings.ssao        = ssao;
+	settings.msaa        = msaa;
+	int width = settings.width, height = settings.height;
+
 	// eye is located on z-axis with distance c from origin
 	Matrix Projection = Matrix::identity(4);
 	Matrix ViewPort   = viewport(0, 0, width, height);
 	Matrix ModelView = lookat(eye, center, up);
 	Projection[3][2] = -1.f / eye.z;
 
-	TGAImage image(width, height, TGAImage::RGB);
-	for (int i=0; i<model->nfaces(); i++) {
-        std::vector<int> face = model->face(i);
-        Vec3i screen_coords[3];
-        Vec3f world_coords[3];
-        Vec2f texture_coords[3];
-        for (int j=0; j<3; j++) {
-			Vec3f v = model->vert(face[j]);
-			world_coords[j] = v;
-			screen_coords[j] = m2v(ViewPort*Projection*ModelView*v2m(v));
-			texture_coords[j] = model->uv(i,j); 
-		}
-		// Vec3f n = (world_coords[2]-world_coords[0])^(world_coords[1]-world_coords[0]);
-		// n.normalize();
-		// float intensity = n*light_dir;
-		// TGAColor color = TGAColor(intensity*255, intensity*255, intensity*255, 255);
-        triangle(screen_coords, texture_coords, image, zbuffer);
-    }
+	// one matrix per frame; the product is grouped as the former per-vertex chain, same rounding
+	mat4 MVP = mat4(ViewPort)*mat4(Projection)*mat4(ModelView);
+	Vec3f light = settings.light_dir*-1.f;
+	Vec3f view = (eye-center).normalize();
 
-	image.flip_vertically(); // i want to have the origin at the left bottom corner of the image
-	image.write_tga_file("output.tga");
-	return 0;
-}
\ No newline at end of file
+	if (bench) {
+		BenchScene scene = {model, MVP, width, height, light, view, obj};
+		return finish(trace, run_benchmark(bench, scene, bench_options) ? 0 : 1);
+	}
+
+	if (check) {
+		return finish(trace, run_golden_checks(model, settings, check_options) ? 0 : 1);
+	}
+
+	if (ssaa>1 && poses.empty()) {
+		// plain supersampling: ssaa^2 times the pixels shaded, then averaged
+		RenderSettings large = settings;
+		large.width  = width*ssaa;
+		large.height = height*ssaa;
+		RenderContext ctx(model, large);
+		ctx.set_verbose(true);
+		ctx.render(mat4(supersampled_viewport(width, height, ssaa))*mat4(Projection)*mat4(ModelView), light, view, ctx.framebuffer());
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		TGAImage image(width, height, TGAImage::RGB);
+		downsample_box(ctx.framebuffer(), image, ssaa, ctx.pool());
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+		std::cerr << "# ssaa " << ssaa << "x" << ssaa << " resolve " << elapsed << " ms" << std::endl;
+		write_output(image, ctx.pool());
+		return finish(trace, 0);
+	}
+
+	RenderContext ctx(model, settings);
+	if (!poses.empty()) {
+		render_batch(poses, out_pattern, ctx);
+		return finish(trace, 0);
+	}
+
+	ctx.set_verbose(true);
+	ctx.render(MVP, light, view, ctx.framebuffer());
+	write_output(ctx.framebuffer(), ctx.pool());
+	return finish(trace, 0);
+}
@@ -0,0 +1,70 @@
+#include <fstream>
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data_(NULL), size_(0), mapped_(false), buffer_() {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char *filename) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    if (fstat(fd, &st)==0 && st.st_size>0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p!=MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            data_ = (const char *)p;
+            size_ = st.st_size;
+            mapped_ = true;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) return false;
+    in.seekg(0, std::ios::end);
+    std::streamoff n = in.tellg();
+    if (n<0) return false;
+    in.seekg(0, std::ios::beg);
+    buffer_.resize(n);
+    if (n>0) in.read(&buffer_[0], n);
+    if (!in.good() && n>0) {
+        buffer_.clear();
+        return false;
+    }
+    data_ = n>0 ? &buffer_[0] : NULL;
+    size_ = n;
+    return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (mapped_) munmap((void *)data_, size_);
+#endif
+    mapped_ = false;
+    buffer_.clear();
+    data_ = NULL;
+    size_ = 0;
+}
+
+const char *MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
@@ -0,0 +1,25 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <vector>
+
+// Read-only view of a whole file: memory-mapped where the OS allows it, read into memory otherwise.
+class MappedFile {
+private:
+	const char *data_;
+	size_t size_;
+	bool mapped_;
+	std::vector<char> buffer_;
+	MappedFile(const MappedFile &);
+	MappedFile & operator =(const MappedFile &);
+public:
+	MappedFile();
+	~MappedFile();
+	bool open(const char *filename);
+	void close();
+	const char *data() const;
+	size_t size() const;
+};
+
+#endif //__MAPPED_FILE_H__
@@ -1,79 +1,299 @@
 #include <iostream>
-#include <string>
 #include <fstream>
-#include <sstream>
+#include <string>
 #include <vector>
+#include <chrono>
+#include <charconv>
 #include "model.h"
+#include "mapped_file.h"
+#include "profile.h"
+
+// Hand-rolled OBJ tokenizer working in place on the mapped file: no line strings, no streams.
+static inline bool is_blank(char c) {
+    return c==' ' || c=='\t' || c=='\r';
+}
+
+static inline void skip_blanks(const char *&p, const char *end) {
+    while (p<end && is_blank(*p)) p++;
+}
+
+static inline void skip_line(const char *&p, const char *end) {
+    while (p<end && *p!='\n') p++;
+    if (p<end) p++;
+}
+
+static inline bool parse_float(const char *&p, const char *end, float &v) {
+    skip_blanks(p, end);
+    if (p<end && *p=='+') p++;
+    std::from_chars_result r = std::from_chars(p, end, v);
+    if (r.ec!=std::errc()) return false;
+    p = r.ptr;
+    return true;
+}
+
+static inline bool parse_int(const char *&p, const char *end, int &v) {
+    bool neg = p<end && *p=='-';
+    if (neg || (p<end && *p=='+')) p++;
+    if (p>=end || *p<'0' || *p>'9') return false;
+    int r = 0;
+    while (p<end && *p>='0' && *p<='9') r = r*10 + (*p++ - '0');
+    v = neg ? -r : r;
+    return true;
+}
+
+// in wavefront obj indices start at 1, negative ones count back from the last element read so far;
+// -1 for a missing index and for one outside the elements read so far, so that the loops over the
+// index buffers only have to test for <0
+static inline int resolve_index(int idx, int count) {
+    int i = idx>0 ? idx-1 : idx<0 ? count+idx : -1;
+    return i>=0 && i<count ? i : -1;
+}
+
+// one face corner: v, v/vt, v//vn or v/vt/vn
+static inline bool parse_corner(const char *&p, const char *end, Vec3i &c, int nv, int nt, int nn) {
+    int idx[3] = {0, 0, 0};
+    if (!parse_int(p, end, idx[0])) return false;
+    if (p<end && *p=='/') {
+        p++;
+        if (p<end && *p!='/') parse_int(p, end, idx[1]);
+        if (p<end && *p=='/') {
+            p++;
+            parse_int(p, end, idx[2]);
+        }
+    }
+    c = Vec3i(resolve_index(idx[0], nv), resolve_index(idx[1], nt), resolve_index(idx[2], nn));
+    return true;
+}
+
+Model::Model(const char *filename, bool use_cache) : facet_vrt_(), facet_tex_(), facet_nrm_(), normal_space_(NORMALS_NONE), specular_(false),
+    filter_(FILTER_POINT) {
+    PROFILE_SCOPE("model load");
+    std::string cachefile = std::string(filename) + ".cache";
+    if (!use_cache || !load_cache(filename, cachefile.c_str())) {
+        load_obj(filename);
+        load_texture(filename, "_diffuse.tga", diffusemap_);
+        if (use_cache) save_cache(filename, cachefile.c_str());
+    }
+    load_surface_maps(filename);
+    {
+        PROFILE_SCOPE("mip build");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        diffusetex_.build(diffusemap_);
+        if (!diffusetex_.empty()) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            std::cerr << "# texture " << diffusetex_.nlevels() << " mip levels, " << diffusetex_.bytes() << " bytes, built in " << seconds*1e3 << " ms" << std::endl;
+        }
+    }
+    // Only for a model with a normal or specular map, MappedShader renders the others from the
+    // diffuse texture. Built here rather than on first use: the shaders read it from the render
+    // threads.
+    if (normalmap_.buffer() || specularmap_.buffer()) {
+        PROFILE_SCOPE("surface maps");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (normal_space_==NORMALS_TANGENT) build_tangents();
+        surface_.build(diffusemap_, normalmap_, specularmap_);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        const char *space[3] = {"none", "tangent space", "object space"};
+        std::cerr << "# surface maps: normal " << space[normal_space_] << ", specular " << (specular_ ? "yes" : "none")
+                  << ", " << surface_.bytes() << " bytes interleaved in " << seconds*1e3 << " ms" << std::endl;
+    }
+}
 
-Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_() {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
+void Model::load_obj(const char *filename) {
+    PROFILE_SCOPE("obj parse");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(filename)) return;
+    const char *p = file.data(), *end = p+file.size();
+    std::vector<Vec3i> corners; // reused by every face, polygons are fan-triangulated
+    while (p<end) {
+        skip_blanks(p, end);
+        if (p+1<end && p[0]=='v' && is_blank(p[1])) {
+            p += 2;
             Vec3f v;
-            for (int i=0;i<3;i++) iss >> v[i];
-            verts_.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
+            for (int i=0;i<3;i++) parse_float(p, end, v[i]);
+            for (int i=0;i<3;i++) verts_[i].push_back(v[i]);
+        } else if (p+2<end && p[0]=='v' && p[1]=='n' && is_blank(p[2])) {
+            p += 3;
             Vec3f n;
-            for (int i=0;i<3;i++) iss >> n[i];
-            norms_.push_back(n);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
+            for (int i=0;i<3;i++) parse_float(p, end, n[i]);
+            for (int i=0;i<3;i++) norms_[i].push_back(n[i]);
+        } else if (p+2<end && p[0]=='v' && p[1]=='t' && is_blank(p[2])) {
+            p += 3;
             Vec2f uv;
-            for (int i=0;i<2;i++) iss >> uv[i];
-            uv_.push_back(uv);
-        }  else if (!line.compare(0, 2, "f ")) {
-            std::vector<Vec3i> f;
-            Vec3i tmp;
-            iss >> trash;
-            while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
-                for (int i=0; i<3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
-                f.push_back(tmp);
+            for (int i=0;i<2;i++) parse_float(p, end, uv[i]);
+            for (int i=0;i<2;i++) uv_[i].push_back(uv[i]);
+        } else if (p+1<end && p[0]=='f' && is_blank(p[1])) {
+            p += 2;
+            corners.clear();
+            Vec3i c;
+            while (true) {
+                skip_blanks(p, end);
+                if (!parse_corner(p, end, c, nverts(), (int)uv_[0].size(), (int)norms_[0].size())) break;
+                corners.push_back(c);
+            }
+            bool valid = corners.size()>=3;
+            for (int i=0; valid && i<(int)corners.size(); i++) {
+                valid = corners[i].ivert>=0 && corners[i].ivert<nverts();
+            }
+            for (int i=1; valid && i+1<(int)corners.size(); i++) {
+                const Vec3i *tri[3] = {&corners[0], &corners[i], &corners[i+1]};
+                for (int j=0; j<3; j++) {
+                    facet_vrt_.push_back(tri[j]->ivert);
+                    facet_tex_.push_back(tri[j]->iuv);
+                    facet_nrm_.push_back(tri[j]->inorm);
+                }
             }
-            faces_.push_back(f);
         }
+        skip_line(p, end);
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
-    load_texture(filename, "_diffuse.tga", diffusemap_);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << uv_[0].size() << " vn# " << norms_[0].size() << std::endl;
+    std::cerr << "# mesh " << mesh_bytes() << " bytes, " << (nfaces() ? double(mesh_bytes())/nfaces() : 0.) << " bytes/triangle" << std::endl;
+    std::cerr << "# obj " << file.size() << " bytes parsed in " << seconds*1e3 << " ms, " << file.size()/1e6/seconds << " MB/s" << std::endl;
 }
 
 Model::~Model() {
 }
 
 int Model::nverts() {
-    return (int)verts_.size();
+    return (int)verts_[0].size();
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return (int)facet_vrt_.size()/3;
 }
 
 std::vector<int> Model::face(int idx) {
-    std::vector<int> face;
-    for (int i=0; i<(int)faces_[idx].size(); i++) {
-        face.push_back(faces_[idx][i][0]);
-    }
-    return face;
+    return std::vector<int>(facet_vrt_.begin()+idx*3, facet_vrt_.begin()+idx*3+3);
 }
 
 Vec3f Model::vert(int i) {
-    return verts_[i];
+    return Vec3f(verts_[0][i], verts_[1][i], verts_[2][i]);
 }
 
-void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
+int Model::vert(int iface, int nthvert) {
+    return facet_vrt_[iface*3+nthvert];
+}
+
+const float *Model::vert_component(int axis) const {
+    return verts_[axis].data();
+}
+
+const float *Model::uv_component(int axis) const {
+    return uv_[axis].data();
+}
+
+const float *Model::norm_component(int axis) const {
+    return norms_[axis].data();
+}
+
+const int *Model::facet_verts() const {
+    return facet_vrt_.data();
+}
+
+const int *Model::facet_uvs() const {
+    return facet_tex_.data();
+}
+
+const int *Model::facet_norms() const {
+    return facet_nrm_.data();
+}
+
+size_t Model::mesh_bytes() const {
+    return sizeof(float)*(3*verts_[0].size() + 2*uv_[0].size() + 3*norms_[0].size())
+         + sizeof(int)*(facet_vrt_.size() + facet_tex_.size() + facet_nrm_.size());
+}
+
+std::string Model::texture_file(std::string filename, const char *suffix) {
     size_t dot = filename.find_last_of(".");
-    if (dot!=std::string::npos) {
-        std::string texfile = filename.substr(0,dot) + std::string(suffix);
-        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
-        img.flip_vertically();
+    if (dot==std::string::npos) return std::string();
+    return filename.substr(0,dot) + std::string(suffix);
+}
+
+void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
+    std::string texfile = texture_file(filename, suffix);
+    if (!texfile.empty()) {
+        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str(), true) ? "ok" : "failed") << std::endl;
+    }
+}
+
+bool Model::load_optional_texture(std::string filename, const char *suffix, TGAImage &img) {
+    std::string texfile = texture_file(filename, suffix);
+    if (texfile.empty() || !std::ifstream(texfile.c_str()).good()) return false;
+    bool ok = img.read_tga_file(texfile.c_str(), true);
+    std::cerr << "texture file " << texfile << " loading " << (ok ? "ok" : "failed") << std::endl;
+    return ok;
+}
+
+// The maps besides the diffuse one are optional, the lit shaders fall back to the interpolated
+// normal and the default exponent; they are not part of the mesh cache.
+void Model::load_surface_maps(const char *filename) {
+    normal_space_ = NORMALS_NONE;
+    if (load_optional_texture(filename, "_nm_tangent.tga", normalmap_)) normal_space_ = NORMALS_TANGENT;
+    else if (load_optional_texture(filename, "_nm.tga", normalmap_)) normal_space_ = NORMALS_OBJECT;
+    specular_ = load_optional_texture(filename, "_spec.tga", specularmap_);
+}
+
+// Per face the tangent and bitangent solving e1 = du1*T + dv1*B, e2 = du2*T + dv2*B, summed per
+// vertex normal and handedness (mirrored uvs must not cancel out), then made orthogonal to the
+// corner's normal.
+void Model::build_tangents() {
+    PROFILE_SCOPE("tangents");
+    int nf = nfaces();
+    std::vector<Vec3f> sum(2*norms_[0].size(), Vec3f(0, 0, 0));
+    std::vector<Vec3f> face_t(nf);
+    std::vector<float> face_w(nf, 1.f);
+    for (int f=0; f<nf; f++) {
+        Vec3f p0 = vert(vert(f, 0)), e1 = vert(vert(f, 1))-p0, e2 = vert(vert(f, 2))-p0;
+        Vec2f t0 = uv(f, 0), d1 = uv(f, 1)-t0, d2 = uv(f, 2)-t0;
+        float r = d1.x*d2.y - d2.x*d1.y;
+        if (r==0) continue; // no uv mapping, the corners get an arbitrary tangent
+        Vec3f t = (e1*d2.y - e2*d1.y)*(1.f/r);
+        Vec3f b = (e2*d1.x - e1*d2.x)*(1.f/r);
+        face_t[f] = t;
+        face_w[f] = ((e1^e2)^t)*b<0 ? -1.f : 1.f;
+        for (int j=0; j<3; j++) {
+            int n = facet_nrm_[f*3+j];
+            if (n>=0) sum[2*n + (face_w[f]<0)] = sum[2*n + (face_w[f]<0)] + t;
+        }
     }
+    for (int k=0; k<4; k++) tangents_[k].resize(3*nf);
+    for (int f=0; f<nf; f++) {
+        for (int j=0; j<3; j++) {
+            int n = facet_nrm_[f*3+j];
+            Vec3f N = normal(f, j);
+            Vec3f t = n>=0 ? sum[2*n + (face_w[f]<0)] : face_t[f];
+            t = t - N*(N*t);
+            if (!(t.norm()>1e-12f)) {
+                t = std::abs(N.x)<.9f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0);
+                t = t - N*(N*t);
+            }
+            t.normalize();
+            for (int k=0; k<3; k++) tangents_[k][f*3+j] = t[k];
+            tangents_[3][f*3+j] = face_w[f];
+        }
+    }
+}
+
+Vec3f Model::face_normal(int iface) {
+    Vec3f v0 = vert(vert(iface, 0));
+    Vec3f v1 = vert(vert(iface, 1));
+    Vec3f v2 = vert(vert(iface, 2));
+    return ((v1-v0)^(v2-v0)).normalize();
+}
+
+Vec3f Model::normal(int iface, int nthvert) {
+    int n = facet_nrm_[iface*3+nthvert];
+    if (n<0 || n>=(int)norms_[0].size()) return face_normal(iface);
+    return Vec3f(norms_[0][n], norms_[1][n], norms_[2][n]).normalize();
+}
+
+vec4 Model::tangent(int iface, int nthvert) {
+    int c = iface*3+nthvert;
+    vec4 t;
+    for (int k=0; k<4; k++) t[k] = tangents_[k][c];
+    return t;
 }
 
 TGAColor Model::diffuse(Vec2f uv){
@@ -81,8 +301,41 @@ TGAColor Model::diffuse(Vec2f uv){
     return diffusemap_.get(uvwh.x,uvwh.y);
 }
 
+TGAColor Model::diffuse(Vec2f uv, float lod) {
+    if (filter_==FILTER_POINT) return diffuse(uv);
+    return TGAColor((int)diffusetex_.sample(uv.x, uv.y, lod, filter_), TGAImage::RGBA);
+}
+
+TGAImage &Model::diffuse_map() {
+    return diffusemap_;
+}
+
+const Texture &Model::diffuse_texture() const {
+    return diffusetex_;
+}
+
+const SurfaceTexture &Model::surface() const {
+    return surface_;
+}
+
+NormalMapSpace Model::normal_map_space() const {
+    return normal_space_;
+}
+
+bool Model::has_specular_map() const {
+    return specular_;
+}
+
+void Model::set_texture_filter(TextureFilter filter) {
+    filter_ = filter;
+}
+
+TextureFilter Model::texture_filter() const {
+    return filter_;
+}
 
 Vec2f Model::uv(int iface, int nvert) {
-    int idx = faces_[iface][nvert][1];
-    return uv_[idx];
+    int idx = facet_tex_[iface*3+nvert];
+    if (idx<0 || idx>=(int)uv_[0].size()) return Vec2f(0, 0);
+    return Vec2f(uv_[0][idx], uv_[1][idx]);
 }
\ No newline at end of file
@@ -2,26 +2,85 @@
 #define __MODEL_H__
 
 #include <vector>
+#include <string>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
 
+// which normal map a model has: _nm_tangent.tga is preferred over the object-space _nm.tga
+enum NormalMapSpace {
+	NORMALS_NONE,
+	NORMALS_TANGENT,
+	NORMALS_OBJECT
+};
+
+// Mesh storage is structure-of-arrays: one contiguous float array per attribute component and
+// three index buffers (position/uv/normal) holding 3 corners per triangle; polygons are
+// triangulated on load. The pointer accessors let hot loops stream through them without copies.
 class Model {
 private:
-	std::vector<Vec3f> verts_;
-	std::vector<std::vector<Vec3i>> faces_;
-	std::vector<Vec3f> norms_;
-	std::vector<Vec2f> uv_;
+	std::vector<float> verts_[3];
+	std::vector<float> uv_[2];
+	std::vector<float> norms_[3];
+	std::vector<int> facet_vrt_;
+	std::vector<int> facet_tex_;
+	std::vector<int> facet_nrm_;
+	std::vector<float> tangents_[4]; // per face corner: unit tangent along +u, handedness
 	TGAImage diffusemap_;
+	TGAImage normalmap_;
+	TGAImage specularmap_;
+	Texture diffusetex_;
+	SurfaceTexture surface_;
+	NormalMapSpace normal_space_;
+	bool specular_;
+	TextureFilter filter_;
+	void load_obj(const char *filename);
 	void load_texture(std::string filename, const char *suffix, TGAImage &img);
+	// false without a message when the file does not exist
+	bool load_optional_texture(std::string filename, const char *suffix, TGAImage &img);
+	void load_surface_maps(const char *filename);
+	void build_tangents();
+	static std::string texture_file(std::string filename, const char *suffix);
+	// binary snapshot of the parsed mesh and decoded diffuse map, see model_cache.cpp
+	bool load_cache(const char *filename, const char *cachefile);
+	bool save_cache(const char *filename, const char *cachefile);
 public:
-	Model(const char *filename);
+	Model(const char *filename, bool use_cache=false);
 	~Model();
 	int nverts();
 	int nfaces();
 	Vec3f vert(int i);
+	int vert(int iface, int nthvert);
 	Vec2f uv(int iface, int nvert);
+	Vec3f face_normal(int iface);
+	// the OBJ vertex normal of a face corner, normalized; the face normal for corners without one
+	Vec3f normal(int iface, int nthvert);
+	// tangent of a face corner: xyz along +u and orthogonal to normal(), w = +-1 the handedness,
+	// the bitangent (along +v) is cross(normal, tangent)*w; averaged over the faces sharing the
+	// vertex normal and handedness; only built for a tangent-space normal map
+	vec4 tangent(int iface, int nthvert);
 	TGAColor diffuse(Vec2f uv);
+	// sampled with the current filter, lod is ignored by FILTER_POINT
+	TGAColor diffuse(Vec2f uv, float lod);
+	TGAImage &diffuse_map();
+	const Texture &diffuse_texture() const;
+	// diffuse, normal and specular maps interleaved per texel, for the lit shaders; empty
+	// without a normal or specular map
+	const SurfaceTexture &surface() const;
+	NormalMapSpace normal_map_space() const;
+	bool has_specular_map() const;
+	void set_texture_filter(TextureFilter filter);
+	TextureFilter texture_filter() const;
 	std::vector<int> face(int idx);
+	const float *vert_component(int axis) const;
+	const float *uv_component(int axis) const;
+	const float *norm_component(int axis) const;
+	const int *facet_verts() const;
+	// -1 where a corner has no uv or normal, the others are valid indices (checked on load)
+	const int *facet_uvs() const;
+	const int *facet_norms() const;
+	// bytes held by the mesh arrays (texture excluded)
+	size_t mesh_bytes() const;
 };
 
 #endif //__MODEL_H__
@@ -0,0 +1,189 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+#include "model.h"
+#include "mapped_file.h"
+#include "profile.h"
+
+// Cache files are a machine-local snapshot (native endianness and float layout):
+//   MeshCacheHeader | x[], y[], z[] | u[], v[] | nx[], ny[], nz[] | vertex[], uv[], normal[] indices | diffuse texels
+// i.e. the structure-of-arrays layout of Model, every array copied with a single memcpy.
+// They are keyed on size and modification time of the OBJ and of the diffuse texture, and the
+// payload is protected by a checksum, so a stale or truncated file is simply rebuilt.
+
+static const char MESH_CACHE_MAGIC[8] = {'T','R','M','E','S','H','\0','\0'};
+static const uint32_t MESH_CACHE_VERSION = 3; // 3: uv and normal indices range-checked on load
+
+#pragma pack(push,1)
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t obj_size;
+	int64_t  obj_mtime;
+	uint64_t tex_size;
+	int64_t  tex_mtime;
+	uint32_t nverts;
+	uint32_t nuvs;
+	uint32_t nnorms;
+	uint32_t ncorners;
+	int32_t  tex_width;
+	int32_t  tex_height;
+	int32_t  tex_bytespp;
+	uint32_t reserved;
+	uint64_t payload_size;
+	uint64_t checksum;
+};
+#pragma pack(pop)
+
+// FNV-1a over 64-bit words, the tail byte by byte
+static uint64_t checksum(const unsigned char *p, size_t n) {
+	uint64_t h = 14695981039346656037ULL;
+	size_t i = 0;
+	for (; i+8<=n; i+=8) {
+		uint64_t w;
+		memcpy(&w, p+i, 8);
+		h = (h^w)*1099511628211ULL;
+	}
+	for (; i<n; i++) {
+		h = (h^p[i])*1099511628211ULL;
+	}
+	return h;
+}
+
+template <class T> static void read_array(const unsigned char *&p, std::vector<T> &v, uint32_t n) {
+	v.resize(n);
+	if (n) memcpy((void *)v.data(), p, n*sizeof(T));
+	p += n*sizeof(T);
+}
+
+template <class T> static void write_array(std::vector<unsigned char> &payload, const std::vector<T> &v) {
+	const unsigned char *p = (const unsigned char *)v.data();
+	payload.insert(payload.end(), p, p+v.size()*sizeof(T));
+}
+
+static void file_stamp(const std::string &filename, uint64_t &size, int64_t &mtime) {
+	std::error_code ec;
+	size = 0;
+	mtime = 0;
+	if (filename.empty()) return;
+	std::uintmax_t s = std::filesystem::file_size(filename, ec);
+	if (ec) return;
+	std::filesystem::file_time_type t = std::filesystem::last_write_time(filename, ec);
+	if (ec) return;
+	size = s;
+	mtime = (int64_t)t.time_since_epoch().count();
+}
+
+bool Model::load_cache(const char *filename, const char *cachefile) {
+	PROFILE_SCOPE("mesh cache load");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MappedFile file;
+	if (!file.open(cachefile) || file.size()<sizeof(MeshCacheHeader)) return false;
+	MeshCacheHeader h;
+	memcpy(&h, file.data(), sizeof(h));
+	if (memcmp(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic)) || h.version!=MESH_CACHE_VERSION || h.header_size!=sizeof(h)) {
+		std::cerr << "mesh cache " << cachefile << " has an unknown format, rebuilding\n";
+		return false;
+	}
+	uint64_t obj_size, tex_size;
+	int64_t obj_mtime, tex_mtime;
+	file_stamp(filename, obj_size, obj_mtime);
+	file_stamp(texture_file(filename, "_diffuse.tga"), tex_size, tex_mtime);
+	if (h.obj_size!=obj_size || h.obj_mtime!=obj_mtime || h.tex_size!=tex_size || h.tex_mtime!=tex_mtime) {
+		std::cerr << "mesh cache " << cachefile << " is out of date, rebuilding\n";
+		return false;
+	}
+	uint64_t texbytes = (uint64_t)std::max(h.tex_width, 0)*std::max(h.tex_height, 0)*std::max(h.tex_bytespp, 0);
+	uint64_t expected = ((uint64_t)h.nverts*3 + (uint64_t)h.nuvs*2 + (uint64_t)h.nnorms*3)*sizeof(float)
+	                  + (uint64_t)h.ncorners*3*sizeof(int) + texbytes;
+	if (h.ncorners%3 || h.payload_size!=expected || file.size()!=sizeof(h)+expected) {
+		std::cerr << "mesh cache " << cachefile << " is truncated, rebuilding\n";
+		return false;
+	}
+	const unsigned char *payload = (const unsigned char *)file.data()+sizeof(h);
+	if (checksum(payload, h.payload_size)!=h.checksum) {
+		std::cerr << "mesh cache " << cachefile << " is corrupted, rebuilding\n";
+		return false;
+	}
+
+	const unsigned char *p = payload;
+	for (int i=0; i<3; i++) read_array(p, verts_[i], h.nverts);
+	for (int i=0; i<2; i++) read_array(p, uv_[i], h.nuvs);
+	for (int i=0; i<3; i++) read_array(p, norms_[i], h.nnorms);
+	read_array(p, facet_vrt_, h.ncorners);
+	read_array(p, facet_tex_, h.ncorners);
+	read_array(p, facet_nrm_, h.ncorners);
+	if (texbytes) {
+		diffusemap_ = TGAImage(h.tex_width, h.tex_height, h.tex_bytespp);
+		memcpy(diffusemap_.buffer(), p, texbytes);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << uv_[0].size() << " vn# " << norms_[0].size() << std::endl;
+	std::cerr << "# mesh " << mesh_bytes() << " bytes, " << (nfaces() ? double(mesh_bytes())/nfaces() : 0.) << " bytes/triangle" << std::endl;
+	std::cerr << "# mesh cache " << cachefile << " loaded in " << seconds*1e3 << " ms" << std::endl;
+	return true;
+}
+
+bool Model::save_cache(const char *filename, const char *cachefile) {
+	MeshCacheHeader h;
+	memset((void *)&h, 0, sizeof(h));
+	memcpy(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic));
+	h.version     = MESH_CACHE_VERSION;
+	h.header_size = sizeof(h);
+	file_stamp(filename, h.obj_size, h.obj_mtime);
+	file_stamp(texture_file(filename, "_diffuse.tga"), h.tex_size, h.tex_mtime);
+	h.nverts   = verts_[0].size();
+	h.nuvs     = uv_[0].size();
+	h.nnorms   = norms_[0].size();
+	h.ncorners = facet_vrt_.size();
+	if (diffusemap_.buffer()) {
+		h.tex_width   = diffusemap_.get_width();
+		h.tex_height  = diffusemap_.get_height();
+		h.tex_bytespp = diffusemap_.get_bytespp();
+	}
+	uint64_t texbytes = (uint64_t)h.tex_width*h.tex_height*h.tex_bytespp;
+
+	std::vector<unsigned char> payload;
+	payload.reserve(mesh_bytes() + texbytes);
+	for (int i=0; i<3; i++) write_array(payload, verts_[i]);
+	for (int i=0; i<2; i++) write_array(payload, uv_[i]);
+	for (int i=0; i<3; i++) write_array(payload, norms_[i]);
+	write_array(payload, facet_vrt_);
+	write_array(payload, facet_tex_);
+	write_array(payload, facet_nrm_);
+	const unsigned char *p = diffusemap_.buffer();
+	if (texbytes) payload.insert(payload.end(), p, p+texbytes);
+	h.payload_size = payload.size();
+	h.checksum     = checksum(payload.data(), payload.size());
+
+	// written under a temporary name and renamed, a concurrent reader never sees half a file
+	std::string tmpfile = std::string(cachefile) + ".tmp";
+	std::ofstream out(tmpfile.c_str(), std::ios::binary);
+	if (!out.is_open()) {
+		std::cerr << "can't write mesh cache " << cachefile << "\n";
+		return false;
+	}
+	out.write((const char *)&h, sizeof(h));
+	out.write((const char *)payload.data(), payload.size());
+	out.close();
+	if (!out.good()) {
+		std::cerr << "can't write mesh cache " << cachefile << "\n";
+		std::remove(tmpfile.c_str());
+		return false;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpfile, cachefile, ec);
+	if (ec) {
+		std::cerr << "can't write mesh cache " << cachefile << "\n";
+		std::remove(tmpfile.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include "msaa.h"
+#include "profile.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define MSAA_X86 1
+#endif
+
+static const int MSAA_BAND = 16; // rows per task of the pool
+
+MsaaBuffer::MsaaBuffer() : width(0), height(0), color(), depth() {
+}
+
+void MsaaBuffer::resize(int w, int h) {
+	width  = w;
+	height = h;
+	color.assign(size_t(w)*h*MSAA_SAMPLES, 0);
+	depth.assign(size_t(w)*h*MSAA_SAMPLES, -std::numeric_limits<float>::max());
+}
+
+void MsaaBuffer::clear(ThreadPool &pool) {
+	size_t row = size_t(width)*MSAA_SAMPLES;
+	pool.parallel_for((height+MSAA_BAND-1)/MSAA_BAND, [&](int band) {
+		size_t begin = size_t(band)*MSAA_BAND*row, end = std::min(size_t(height), size_t(band+1)*MSAA_BAND)*row;
+		std::fill(color.begin()+begin, color.begin()+end, 0);
+		std::fill(depth.begin()+begin, depth.begin()+end, -std::numeric_limits<float>::max());
+	});
+}
+
+size_t MsaaBuffer::bytes() const {
+	return color.size()*sizeof(uint32_t) + depth.size()*sizeof(float);
+}
+
+// rows [y0, y1) of the resolve
+static void resolve_rows(const MsaaBuffer &buffer, TGAImage &image, float *zbuffer, int y0, int y1) {
+	int width = buffer.width, bpp = image.get_bytespp();
+	for (int y=y0; y<y1; y++) {
+		const uint32_t *src = buffer.color.data() + size_t(y)*width*MSAA_SAMPLES;
+		const float *dsrc = buffer.depth.data() + size_t(y)*width*MSAA_SAMPLES;
+		unsigned char *dst = image.buffer() + size_t(y)*width*bpp;
+		float *zdst = zbuffer ? zbuffer + size_t(y)*width : NULL;
+		int x = 0;
+#ifdef MSAA_X86
+		const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(MSAA_SAMPLES/2);
+		alignas(16) unsigned char out[16];
+		for (; x+4<=width; x+=4) {
+			// per pixel: the four samples widened to 16 bits and summed channel by channel
+			__m128i sums[4];
+			for (int k=0; k<4; k++) {
+				__m128i s = _mm_loadu_si128((const __m128i *)(src + (x+k)*MSAA_SAMPLES));
+				__m128i t = _mm_add_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero));
+				sums[k] = _mm_add_epi16(t, _mm_srli_si128(t, 8));
+			}
+			__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[0], sums[1]), round), 2);
+			__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[2], sums[3]), round), 2);
+			__m128i pixels = _mm_packus_epi16(lo, hi);
+			if (bpp==4) {
+				_mm_storeu_si128((__m128i *)(dst + x*4), pixels);
+			} else {
+				_mm_store_si128((__m128i *)out, pixels);
+				for (int k=0; k<4; k++) memcpy(dst + (x+k)*bpp, out + 4*k, bpp);
+			}
+			if (zdst) {
+				__m128 d0 = _mm_loadu_ps(dsrc + x*MSAA_SAMPLES), d1 = _mm_loadu_ps(dsrc + (x+1)*MSAA_SAMPLES);
+				__m128 d2 = _mm_loadu_ps(dsrc + (x+2)*MSAA_SAMPLES), d3 = _mm_loadu_ps(dsrc + (x+3)*MSAA_SAMPLES);
+				_MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+				_mm_storeu_ps(zdst + x, _mm_max_ps(_mm_max_ps(d0, d1), _mm_max_ps(d2, d3)));
+			}
+		}
+#endif
+		for (; x<width; x++) {
+			const unsigned char *s = (const unsigned char *)(src + x*MSAA_SAMPLES);
+			for (int c=0; c<bpp; c++) {
+				int sum = MSAA_SAMPLES/2;
+				for (int k=0; k<MSAA_SAMPLES; k++) sum += s[4*k+c];
+				dst[x*bpp+c] = (unsigned char)(sum/MSAA_SAMPLES);
+			}
+			if (zdst) zdst[x] = *std::max_element(dsrc + x*MSAA_SAMPLES, dsrc + (x+1)*MSAA_SAMPLES);
+		}
+	}
+}
+
+void msaa_resolve(const MsaaBuffer &buffer, TGAImage &image, float *zbuffer, ThreadPool &pool) {
+	PROFILE_SCOPE("msaa resolve");
+	int height = buffer.height;
+	pool.parallel_for((height+MSAA_BAND-1)/MSAA_BAND, [&](int band) {
+		resolve_rows(buffer, image, zbuffer, band*MSAA_BAND, std::min(height, (band+1)*MSAA_BAND));
+	});
+}
+
+void downsample_box(TGAImage &src, TGAImage &dst, int factor, ThreadPool &pool) {
+	PROFILE_SCOPE("ssaa resolve");
+	int width = dst.get_width(), height = dst.get_height(), bpp = dst.get_bytespp(), swidth = src.get_width();
+	int n = factor*factor;
+	const unsigned char *in = src.buffer();
+	unsigned char *out = dst.buffer();
+	pool.parallel_for((height+MSAA_BAND-1)/MSAA_BAND, [&](int band) {
+		for (int y=band*MSAA_BAND; y<std::min(height, (band+1)*MSAA_BAND); y++) {
+			if (factor==2) {
+				// the common case with the block unrolled, a pixel is bpp consecutive bytes of both rows
+				const unsigned char *r0 = in + size_t(2*y)*swidth*bpp, *r1 = r0 + size_t(swidth)*bpp;
+				unsigned char *o = out + size_t(y)*width*bpp;
+				for (int x=0; x<width; x++, r0+=2*bpp, r1+=2*bpp, o+=bpp) {
+					for (int c=0; c<bpp; c++) o[c] = (unsigned char)((r0[c] + r0[c+bpp] + r1[c] + r1[c+bpp] + 2)>>2);
+				}
+				continue;
+			}
+			for (int x=0; x<width; x++) {
+				for (int c=0; c<bpp; c++) {
+					int sum = n/2;
+					for (int j=0; j<factor; j++) {
+						const unsigned char *row = in + (size_t(y*factor+j)*swidth + x*factor)*bpp + c;
+						for (int i=0; i<factor; i++) sum += row[i*bpp];
+					}
+					out[(size_t(y)*width+x)*bpp+c] = (unsigned char)(sum/n);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,39 @@
+#ifndef __MSAA_H__
+#define __MSAA_H__
+
+#include <vector>
+#include <cstdint>
+#include "tgaimage.h"
+#include "threadpool.h"
+
+const int MSAA_SAMPLES = 4;
+
+// Sample positions of the 4x mode in sub-pixel units (1/16 pixel) from the pixel centre: a rotated
+// grid, so that near-horizontal and near-vertical edges both get four distinct coverage steps.
+const int MSAA_POSITIONS[MSAA_SAMPLES][2] = {{-2, -6}, {6, -2}, {2, 6}, {-6, 2}};
+const int MSAA_REACH = 6; // largest offset, what the bounding box of a triangle grows by
+
+// Multisampled colour and depth. The samples of a pixel are contiguous (16 bytes of colour, the
+// TGAColor words, and 16 of depth), so the rasterizer touches one cache line per pixel and the
+// resolve reads the colour as one SSE register per pixel.
+struct MsaaBuffer {
+	int width, height;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;   // -FLT_MAX for no sample, larger values nearer to the viewer
+	MsaaBuffer();
+	void resize(int w, int h);
+	void clear(ThreadPool &pool);
+	size_t bytes() const;
+};
+
+// Box filter of the samples of every pixel into image (same size, 1, 3 or 4 bytes per pixel),
+// rounded to nearest; zbuffer, when not NULL, gets the nearest sample depth of the pixel, as a
+// single-sampled pass would leave it for the post-passes. Rows in bands on the pool, four pixels
+// per SSE register.
+void msaa_resolve(const MsaaBuffer &buffer, TGAImage &image, float *zbuffer, ThreadPool &pool);
+
+// The plain supersampling resolve: the average of every factor x factor block of src into dst,
+// which is factor times smaller, both with the same bytes per pixel.
+void downsample_box(TGAImage &src, TGAImage &dst, int factor, ThreadPool &pool);
+
+#endif //__MSAA_H__
@@ -0,0 +1,459 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "rasterizer.h"
+#include "cull.h"
+#include "tiler.h"
+#include "threadpool.h"
+#include "shader.h"
+#include "msaa.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PIPELINE_X86 1
+#endif
+#include "profile.h"
+
+// The programmable path. Templates over the shader type: with one of the final shaders the
+// fragment call is inlined and the varying loops have a constant trip count, with IShader every
+// call is virtual. Rasterization is RASTER_EDGE (same coverage and depth values). Depth is
+// z/w and affine in screen space, varyings are interpolated as VaryingLayout says.
+
+// runs the vertex shader on every face corner, then culls and clips like PrimitiveCuller::assemble
+template <class Shader> void assemble_shaded(Model &model, Shader &shader, PrimitiveCuller &culler, std::vector<ShadedTriangle> &tris) {
+	PROFILE_SCOPE("vertex shading and assembly");
+	int nfaces = model.nfaces();
+	const int nvaryings = shader.layout().count();
+	culler.reset_stats();
+	tris.clear();
+	tris.reserve(nfaces);
+	ShadedTriangle t;
+	ClipVertex poly[MAX_CLIP_VERTS];
+	for (int i=0; i<nfaces; i++) {
+		vec4 h[3];
+		for (int j=0; j<3; j++) h[j] = shader.vertex(i, j, t.varyings[j]);
+		CullResult r = culler.classify(h);
+		if (r==PRIM_CULLED) continue;
+		if (r==PRIM_INSIDE) {
+			for (int j=0; j<3; j++) {
+				t.pts[j]  = Vec3f(h[j][0]/h[j][3], h[j][1]/h[j][3], h[j][2]/h[j][3]);
+				t.invw[j] = 1.f/h[j][3];
+			}
+			tris.push_back(t);
+			continue;
+		}
+		// clipping interpolates in clip space, which is exact for the perspective-correct varyings
+		const float *varyings[3] = {t.varyings[0], t.varyings[1], t.varyings[2]};
+		int n = culler.clip(h, varyings, nvaryings, poly);
+		for (int k=1; k+1<n; k++) {
+			const ClipVertex *c[3] = {&poly[0], &poly[k], &poly[k+1]};
+			ShadedTriangle f;
+			for (int j=0; j<3; j++) {
+				f.pts[j]  = Vec3f(c[j]->h[0]/c[j]->h[3], c[j]->h[1]/c[j]->h[3], c[j]->h[2]/c[j]->h[3]);
+				f.invw[j] = 1.f/c[j]->h[3];
+				for (int v=0; v<nvaryings; v++) f.varyings[j][v] = c[j]->varyings[v];
+			}
+			tris.push_back(f);
+		}
+	}
+	culler.count_out(tris.size());
+}
+
+// Every varying of a triangle as the plane a0 + l1*(a1-a0) + l2*(a2-a0) over the barycentric
+// weights of corners c1 and c2 (swapped when the edge setup flipped the triangle), in three
+// contiguous arrays the per-pixel loops stream through; perspective-correct ones are a/w planes,
+// divided by the interpolated 1/w. Flat ones are kept in base.
+struct VaryingPlanes {
+	float q0, dq1, dq2;
+	float base[MAX_VARYINGS], d1[MAX_VARYINGS], d2[MAX_VARYINGS];
+};
+
+// inline with the layout of a final shader, the loops have constant trip counts
+inline void setup_planes(const ShadedTriangle &t, bool flipped, const VaryingLayout layout, VaryingPlanes &p) {
+	const int np = layout.perspective, nl = np+layout.linear, nf = nl+layout.flat;
+	const int c1 = flipped ? 2 : 1, c2 = flipped ? 1 : 2;
+	const float *v0 = t.varyings[0], *v1 = t.varyings[c1], *v2 = t.varyings[c2];
+	p.q0 = t.invw[0];
+	p.dq1 = t.invw[c1]-p.q0;
+	p.dq2 = t.invw[c2]-p.q0;
+	for (int k=0; k<np; k++) {
+		p.base[k] = v0[k]*p.q0;
+		p.d1[k] = v1[k]*t.invw[c1] - p.base[k];
+		p.d2[k] = v2[k]*t.invw[c2] - p.base[k];
+	}
+	for (int k=np; k<nl; k++) {
+		p.base[k] = v0[k];
+		p.d1[k] = v1[k]-v0[k];
+		p.d2[k] = v2[k]-v0[k];
+	}
+	for (int k=nl; k<nf; k++) p.base[k] = v0[k];
+}
+
+// the perspective-correct and linear varyings at weights l1, l2; flat ones are left alone
+inline void interpolate_planes(const VaryingPlanes &p, const VaryingLayout layout, float l1, float l2, float *varyings) {
+	const int np = layout.perspective, nl = np+layout.linear;
+	for (int k=0; k<nl; k++) varyings[k] = p.base[k] + l1*p.d1[k] + l2*p.d2[k];
+	if (np) {
+		float w = 1.f/(p.q0 + l1*p.dq1 + l2*p.dq2);
+		for (int k=0; k<np; k++) varyings[k] *= w;
+	}
+}
+
+inline void flat_varyings(const VaryingPlanes &p, const VaryingLayout layout, float *varyings) {
+	const int nl = layout.perspective+layout.linear, nf = nl+layout.flat;
+	for (int k=nl; k<nf; k++) varyings[k] = p.base[k];
+}
+
+// rasterizes the part of t inside [clipmin, clipmax], returns the number of fragment shader calls
+template <class Shader> long draw_shaded(const ShadedTriangle &t, const Shader &shader, TGAImage &image, float *zbuffer, Vec2i clipmin, Vec2i clipmax) {
+	EdgeTriangle e;
+	if (!setup_edges(t.pts, clipmin, clipmax, e)) return 0;
+	const VaryingLayout layout = shader.layout();
+	VaryingPlanes planes;
+	float varyings[MAX_VARYINGS];
+	setup_planes(t, e.flipped, layout, planes);
+	flat_varyings(planes, layout, varyings);
+	long shaded = 0, tested = 0;
+	int width = image.get_width();
+	int64_t row[3] = {e.row[0], e.row[1], e.row[2]};
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+		for (int px=e.bboxmin.x; px<=e.bboxmax.x; px++) {
+			if ((w0|w1|w2)>=0) {
+				float l0 = float(w0+e.bias[0])*e.inv_area;
+				float l1 = float(w1+e.bias[1])*e.inv_area;
+				float l2 = float(w2+e.bias[2])*e.inv_area;
+				float pz = l0*e.z[0] + l1*e.z[1] + l2*e.z[2];
+				int idx = px+py*width;
+				tested++;
+				if (zbuffer[idx]<pz) {
+					interpolate_planes(planes, layout, l1, l2, varyings);
+					TGAColor color;
+					shaded++;
+					if (shader.fragment(varyings, color)) {
+						zbuffer[idx] = pz;
+						image.set(px, py, color);
+					}
+				}
+			}
+			w0 += e.stepx[0]; w1 += e.stepx[1]; w2 += e.stepx[2];
+		}
+		for (int i=0; i<3; i++) row[i] += e.stepy[i];
+	}
+	if (profiling()) {
+		profile_add(COUNT_PIXELS_TESTED, tested);
+		profile_add(COUNT_PIXELS_PASSED, shaded);
+		profile_add(COUNT_FRAGMENTS_SHADED, shaded);
+		profile_add(COUNT_TEXELS_FETCHED, shaded*shader.texels());
+	}
+	return shaded;
+}
+
+// the whole frame, serially when tiler is NULL, otherwise binned and spread over the pool
+template <class Shader> long render_shaded(const std::vector<ShadedTriangle> &tris, const Shader &shader, TGAImage &image, float *zbuffer, Tiler *tiler, ThreadPool &pool) {
+	if (!tiler) {
+		PROFILE_SCOPE("raster");
+		long shaded = 0;
+		Vec2i clipmax(image.get_width()-1, image.get_height()-1);
+		for (int i=0; i<(int)tris.size(); i++) {
+			shaded += draw_shaded(tris[i], shader, image, zbuffer, Vec2i(0, 0), clipmax);
+		}
+		return shaded;
+	}
+	std::atomic<long> shaded(0);
+	tiler->bin(tris);
+	PROFILE_SCOPE("raster");
+	pool.parallel_for(tiler->ntiles(), [&](int tile) {
+		if (!tiler->bin_size(tile)) return;
+		PROFILE_SCOPE("raster tile");
+		Vec2i clipmin, clipmax;
+		tiler->tile_rect(tile, clipmin, clipmax);
+		const int *bin = tiler->bin_triangles(tile);
+		long n = 0;
+		for (int i=0; i<tiler->bin_size(tile); i++) {
+			n += draw_shaded(tris[bin[i]], shader, image, zbuffer, clipmin, clipmax);
+		}
+		shaded += n;
+	});
+	return shaded;
+}
+
+// true when the edge values of every sample of e fit the 32-bit lanes of the MSAA kernel: the
+// functions are affine, the corners of the bounding box grown by a pixel bound them
+inline bool msaa_fits_int32(const EdgeTriangle &e) {
+	const int64_t lim = int64_t(1)<<30;
+	int64_t w = e.bboxmax.x-e.bboxmin.x+1, h = e.bboxmax.y-e.bboxmin.y+1;
+	for (int i=0; i<3; i++) {
+		for (int c=0; c<4; c++) {
+			int64_t v = e.row[i] + (c&1 ? w*e.stepx[i] : -e.stepx[i]) + (c&2 ? h*e.stepy[i] : -e.stepy[i]);
+			if (v>lim || v<-lim) return false;
+		}
+	}
+	return true;
+}
+
+// 4x MSAA into target (msaa.h): coverage and depth at the MSAA_POSITIONS samples, the fragment
+// shader once per pixel and triangle, its colour stored to every sample that passed. The shader
+// runs at the pixel centre when the centre is covered, otherwise at the first passing sample, so
+// the varyings are never extrapolated beyond the triangle. The four samples of a pixel are one SSE
+// register when the edge values fit 32 bits. Returns the fragment shader calls.
+template <class Shader> long draw_msaa(const ShadedTriangle &t, const Shader &shader, MsaaBuffer &target, Vec2i clipmin, Vec2i clipmax) {
+	EdgeTriangle e;
+	if (!setup_edges(t.pts, clipmin, clipmax, e, MSAA_REACH)) return 0;
+	const VaryingLayout layout = shader.layout();
+	VaryingPlanes planes;
+	float varyings[MAX_VARYINGS];
+	setup_planes(t, e.flipped, layout, planes);
+	flat_varyings(planes, layout, varyings);
+	// edge values of the samples relative to the pixel centre, exact as the steps are multiples of one sub-pixel
+	int64_t offset[MSAA_SAMPLES][3];
+	for (int k=0; k<MSAA_SAMPLES; k++) {
+		for (int i=0; i<3; i++) offset[k][i] = (e.stepx[i]*MSAA_POSITIONS[k][0] + e.stepy[i]*MSAA_POSITIONS[k][1])/(1<<SUBPIXEL_BITS);
+	}
+	long shaded = 0, tested = 0, passed = 0;
+	int width = target.width;
+	int64_t row[3] = {e.row[0], e.row[1], e.row[2]};
+	// the shader input of a pixel whose passing samples are mask, centre edge values w1, w2
+	auto shade = [&](int mask, int64_t c0, int64_t c1, int64_t c2, TGAColor &color) {
+		if ((c0|c1|c2)<0) {
+			int k = __builtin_ctz(mask);
+			c1 += offset[k][1];
+			c2 += offset[k][2];
+		}
+		interpolate_planes(planes, layout, float(c1+e.bias[1])*e.inv_area, float(c2+e.bias[2])*e.inv_area, varyings);
+		shaded++;
+		return shader.fragment(varyings, color);
+	};
+#ifdef PIPELINE_X86
+	if (msaa_fits_int32(e)) {
+		const __m128i minus1 = _mm_set1_epi32(-1);
+		const __m128 inv_area = _mm_set1_ps(e.inv_area);
+		const __m128 z0 = _mm_set1_ps(e.z[0]), z1 = _mm_set1_ps(e.z[1]), z2 = _mm_set1_ps(e.z[2]);
+		__m128i off[3], bias[3], stepx[3];
+		for (int i=0; i<3; i++) {
+			off[i] = _mm_set_epi32(int(offset[3][i]), int(offset[2][i]), int(offset[1][i]), int(offset[0][i]));
+			bias[i] = _mm_set1_epi32(int(e.bias[i]));
+			stepx[i] = _mm_set1_epi32(int(e.stepx[i]));
+		}
+		for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+			int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+			__m128i s0 = _mm_add_epi32(_mm_set1_epi32(int(w0)), off[0]);
+			__m128i s1 = _mm_add_epi32(_mm_set1_epi32(int(w1)), off[1]);
+			__m128i s2 = _mm_add_epi32(_mm_set1_epi32(int(w2)), off[2]);
+			size_t idx = (size_t(py)*width+e.bboxmin.x)*MSAA_SAMPLES;
+			for (int px=e.bboxmin.x; px<=e.bboxmax.x; px++, idx+=MSAA_SAMPLES) {
+				__m128i covered = _mm_cmpgt_epi32(_mm_or_si128(s0, _mm_or_si128(s1, s2)), minus1);
+				int cbits = _mm_movemask_ps(_mm_castsi128_ps(covered));
+				if (cbits) {
+					__m128 l0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(s0, bias[0])), inv_area);
+					__m128 l1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(s1, bias[1])), inv_area);
+					__m128 l2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(s2, bias[2])), inv_area);
+					__m128 pz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, z0), _mm_mul_ps(l1, z1)), _mm_mul_ps(l2, z2));
+					float *depth = target.depth.data()+idx;
+					__m128 zb = _mm_loadu_ps(depth);
+					__m128 pass = _mm_and_ps(_mm_castsi128_ps(covered), _mm_cmplt_ps(zb, pz));
+					int mask = _mm_movemask_ps(pass);
+					tested += __builtin_popcount(cbits);
+					TGAColor color;
+					if (mask && shade(mask, w0, w1, w2, color)) {
+						__m128i *samples = (__m128i *)(target.color.data()+idx);
+						__m128i pm = _mm_castps_si128(pass);
+						__m128i c = _mm_loadu_si128(samples);
+						_mm_storeu_si128(samples, _mm_or_si128(_mm_and_si128(pm, _mm_set1_epi32(int(color.val))), _mm_andnot_si128(pm, c)));
+						_mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(pass, pz), _mm_andnot_ps(pass, zb)));
+						passed += __builtin_popcount(mask);
+					}
+				}
+				s0 = _mm_add_epi32(s0, stepx[0]); s1 = _mm_add_epi32(s1, stepx[1]); s2 = _mm_add_epi32(s2, stepx[2]);
+				w0 += e.stepx[0]; w1 += e.stepx[1]; w2 += e.stepx[2];
+			}
+			for (int i=0; i<3; i++) row[i] += e.stepy[i];
+		}
+	} else
+#endif
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+		for (int px=e.bboxmin.x; px<=e.bboxmax.x; px++) {
+			size_t idx = (size_t(py)*width+px)*MSAA_SAMPLES;
+			float *depth = target.depth.data()+idx;
+			float pz[MSAA_SAMPLES];
+			int mask = 0;
+			for (int k=0; k<MSAA_SAMPLES; k++) {
+				int64_t s0 = w0+offset[k][0], s1 = w1+offset[k][1], s2 = w2+offset[k][2];
+				if ((s0|s1|s2)<0) continue;
+				float l0 = float(s0+e.bias[0])*e.inv_area;
+				float l1 = float(s1+e.bias[1])*e.inv_area;
+				float l2 = float(s2+e.bias[2])*e.inv_area;
+				pz[k] = l0*e.z[0] + l1*e.z[1] + l2*e.z[2];
+				tested++;
+				if (depth[k]<pz[k]) mask |= 1<<k;
+			}
+			TGAColor color;
+			if (mask && shade(mask, w0, w1, w2, color)) {
+				uint32_t *samples = target.color.data()+idx;
+				for (int k=0; k<MSAA_SAMPLES; k++) {
+					if (!(mask>>k&1)) continue;
+					depth[k] = pz[k];
+					samples[k] = color.val;
+					passed++;
+				}
+			}
+			w0 += e.stepx[0]; w1 += e.stepx[1]; w2 += e.stepx[2];
+		}
+		for (int i=0; i<3; i++) row[i] += e.stepy[i];
+	}
+	if (profiling()) {
+		profile_add(COUNT_PIXELS_TESTED, tested);
+		profile_add(COUNT_PIXELS_PASSED, passed);
+		profile_add(COUNT_FRAGMENTS_SHADED, shaded);
+		profile_add(COUNT_TEXELS_FETCHED, shaded*shader.texels());
+	}
+	return shaded;
+}
+
+// the whole multisampled frame, threads as for render_shaded
+template <class Shader> long render_msaa(const std::vector<ShadedTriangle> &tris, const Shader &shader, MsaaBuffer &target, Tiler *tiler, ThreadPool &pool) {
+	Vec2i clipmax(target.width-1, target.height-1);
+	if (!tiler) {
+		PROFILE_SCOPE("raster");
+		long shaded = 0;
+		for (int i=0; i<(int)tris.size(); i++) shaded += draw_msaa(tris[i], shader, target, Vec2i(0, 0), clipmax);
+		return shaded;
+	}
+	std::atomic<long> shaded(0);
+	tiler->bin(tris);
+	PROFILE_SCOPE("raster");
+	pool.parallel_for(tiler->ntiles(), [&](int tile) {
+		if (!tiler->bin_size(tile)) return;
+		PROFILE_SCOPE("raster tile");
+		Vec2i tmin, tmax;
+		tiler->tile_rect(tile, tmin, tmax);
+		const int *bin = tiler->bin_triangles(tile);
+		long n = 0;
+		for (int i=0; i<tiler->bin_size(tile); i++) n += draw_msaa(tris[bin[i]], shader, target, tmin, tmax);
+		shaded += n;
+	});
+	return shaded;
+}
+
+// What the shading pass of the deferred mode keeps of a triangle: the edge functions of corners
+// 1 and 2 (after the flip of the edge setup) at pixel (0, 0), unbiased, and the varying planes.
+// The weights of any pixel are then the exact integers the forward rasterizer steps to.
+struct DeferredTriangle {
+	int64_t w[2], stepx[2], stepy[2];
+	float inv_area;
+	VaryingPlanes planes;
+};
+
+// Deferred mode buffers. Rasterization writes the depth and, per pixel, the index of the triangle
+// in front (-1 for none): 4 bytes per pixel, the barycentric weights are recomputed from the
+// triangle's edges when the pixel is shaded. Shading then runs once per visible pixel, in row
+// bands spread over the pool, and gives the forward result for shaders that never discard.
+struct GBuffer {
+	std::vector<int> ids;
+	std::vector<DeferredTriangle> tris;
+	long written;        // depth writes, what the forward mode would have shaded
+	long shaded;
+	double raster_ms, shade_ms;
+	GBuffer() : written(0), shaded(0), raster_ms(0), shade_ms(0) {}
+};
+
+const int DEFERRED_BAND = 16; // rows per shading job
+
+// the frame through the G-buffer, threads as for render_shaded; returns the fragment shader calls
+template <class Shader> long render_deferred(const std::vector<ShadedTriangle> &tris, const Shader &shader, TGAImage &image, float *zbuffer, GBuffer &gbuffer, Tiler *tiler, ThreadPool &pool) {
+	int width = image.get_width(), height = image.get_height();
+	const VaryingLayout layout = shader.layout();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	gbuffer.ids.assign(size_t(width)*height, -1);
+	int *ids = gbuffer.ids.data();
+	long written = 0;
+	if (!tiler) {
+		PROFILE_SCOPE("gbuffer");
+		for (int i=0; i<(int)tris.size(); i++) {
+			written += triangle_visibility(tris[i].pts, i, zbuffer, ids, width, Vec2i(0, 0), Vec2i(width-1, height-1));
+		}
+	} else {
+		std::atomic<long> n(0);
+		tiler->bin(tris);
+		PROFILE_SCOPE("gbuffer");
+		pool.parallel_for(tiler->ntiles(), [&](int tile) {
+			if (!tiler->bin_size(tile)) return;
+			PROFILE_SCOPE("gbuffer tile");
+			Vec2i clipmin, clipmax;
+			tiler->tile_rect(tile, clipmin, clipmax);
+			const int *bin = tiler->bin_triangles(tile);
+			long w = 0;
+			for (int i=0; i<tiler->bin_size(tile); i++) {
+				w += triangle_visibility(tris[bin[i]].pts, bin[i], zbuffer, ids, width, clipmin, clipmax);
+			}
+			n += w;
+		});
+		written = n;
+	}
+	std::chrono::steady_clock::time_point raster_end = std::chrono::steady_clock::now();
+
+	PROFILE_SCOPE("deferred shading");
+	int ntris = (int)tris.size();
+	gbuffer.tris.resize(ntris);
+	const int chunk = 256;
+	int jobs = tiler ? (ntris+chunk-1)/chunk : 1;
+	auto setup = [&](int job) {
+		int end = tiler ? std::min(ntris, (job+1)*chunk) : ntris;
+		for (int i=tiler ? job*chunk : 0; i<end; i++) {
+			DeferredTriangle &d = gbuffer.tris[i];
+			EdgeTriangle e;
+			if (!setup_edges(tris[i].pts, Vec2i(0, 0), Vec2i(width-1, height-1), e)) continue; // never in front
+			for (int k=0; k<2; k++) {
+				d.w[k] = e.row[k+1]+e.bias[k+1] - e.bboxmin.x*e.stepx[k+1] - e.bboxmin.y*e.stepy[k+1];
+				d.stepx[k] = e.stepx[k+1];
+				d.stepy[k] = e.stepy[k+1];
+			}
+			d.inv_area = e.inv_area;
+			setup_planes(tris[i], e.flipped, layout, d.planes);
+		}
+	};
+	std::atomic<long> shaded(0);
+	auto shade = [&](int band) {
+		int y0 = tiler ? band*DEFERRED_BAND : 0, y1 = tiler ? std::min(height, y0+DEFERRED_BAND) : height;
+		float varyings[MAX_VARYINGS];
+		long n = 0;
+		for (int py=y0; py<y1; py++) {
+			const int *row = ids+py*width;
+			for (int px=0; px<width; px++) {
+				if (row[px]<0) continue;
+				const DeferredTriangle &d = gbuffer.tris[row[px]];
+				float l1 = float(d.w[0] + px*d.stepx[0] + py*d.stepy[0])*d.inv_area;
+				float l2 = float(d.w[1] + px*d.stepx[1] + py*d.stepy[1])*d.inv_area;
+				flat_varyings(d.planes, layout, varyings);
+				interpolate_planes(d.planes, layout, l1, l2, varyings);
+				TGAColor color;
+				n++;
+				if (shader.fragment(varyings, color)) image.set(px, py, color);
+			}
+		}
+		shaded += n;
+	};
+	if (tiler) {
+		pool.parallel_for(jobs, setup);
+		pool.parallel_for((height+DEFERRED_BAND-1)/DEFERRED_BAND, shade);
+	} else {
+		setup(0);
+		shade(0);
+	}
+	gbuffer.written = written;
+	gbuffer.shaded = shaded;
+	gbuffer.raster_ms = std::chrono::duration<double, std::milli>(raster_end-start).count();
+	gbuffer.shade_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-raster_end).count();
+	if (profiling()) {
+		profile_add(COUNT_FRAGMENTS_SHADED, gbuffer.shaded);
+		profile_add(COUNT_TEXELS_FETCHED, gbuffer.shaded*shader.texels());
+	}
+	return gbuffer.shaded;
+}
+
+#endif //__PIPELINE_H__
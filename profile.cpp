@@ -0,0 +1,164 @@
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include "profile.h"
+
+std::atomic<bool> profile_on(false);
+
+struct ProfileEvent {
+	const char *name;
+	int64_t start, end;
+};
+
+// written by its thread only; counters are atomics so that the exports may read them at any time
+struct ProfileBuffer {
+	int tid;
+	std::vector<ProfileEvent> events;
+	std::atomic<int64_t> counters[PROFILE_NCOUNTERS];
+};
+
+static const char *counter_names[PROFILE_NCOUNTERS] = {
+	"triangles in", "triangles culled", "pixels tested", "pixels passed z", "fragments shaded", "texels fetched", "bytes written"
+};
+
+static std::mutex registry_mutex;
+static std::vector<ProfileBuffer *> registry; // never freed, events outlive their threads
+static thread_local ProfileBuffer *local_buffer = NULL;
+static std::chrono::steady_clock::time_point epoch;
+static bool epoch_set = false;
+
+static ProfileBuffer &buffer() {
+	if (!local_buffer) {
+		ProfileBuffer *b = new ProfileBuffer;
+		for (int i=0; i<PROFILE_NCOUNTERS; i++) b->counters[i].store(0);
+		b->events.reserve(1024);
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		b->tid = (int)registry.size()+1;
+		registry.push_back(b);
+		local_buffer = b;
+	}
+	return *local_buffer;
+}
+
+void profile_enable(bool on) {
+#ifndef NO_PROFILE
+	if (on && !epoch_set) {
+		epoch = std::chrono::steady_clock::now();
+		epoch_set = true;
+	}
+	profile_on.store(on);
+#endif
+}
+
+int64_t profile_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-epoch).count();
+}
+
+void profile_event(const char *name, int64_t start, int64_t end) {
+	ProfileEvent e = {name, start, end};
+	buffer().events.push_back(e);
+}
+
+void profile_add(ProfileCounter c, long n) {
+	std::atomic<int64_t> &counter = buffer().counters[c];
+	counter.store(counter.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+}
+
+static int64_t counter_total(int c) {
+	int64_t total = 0;
+	for (ProfileBuffer *b : registry) total += b->counters[c].load(std::memory_order_relaxed);
+	return total;
+}
+
+// names are string literals from the code, only quotes and backslashes need escaping
+static std::string json_string(const char *s) {
+	std::string r = "\"";
+	for (; *s; s++) {
+		if (*s=='"' || *s=='\\') r += '\\';
+		r += *s;
+	}
+	return r + "\"";
+}
+
+bool profile_write_trace(const char *filename) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		std::cerr << "can't write trace " << filename << "\n";
+		return false;
+	}
+	char buf[256];
+	int64_t last = 0;
+	out << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (ProfileBuffer *b : registry) {
+		snprintf(buf, sizeof(buf), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+		         b->tid, b->tid==1 ? "main" : "worker", b->tid);
+		out << (first ? "" : ",\n") << buf;
+		first = false;
+		for (const ProfileEvent &e : b->events) {
+			snprintf(buf, sizeof(buf), ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			         b->tid, e.start/1e3, (e.end-e.start)/1e3);
+			out << ",\n{\"name\":" << json_string(e.name) << buf;
+			last = std::max(last, e.end);
+		}
+	}
+	out << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << last/1e3 << ",\"args\":{";
+	for (int c=0; c<PROFILE_NCOUNTERS; c++) {
+		out << (c ? "," : "") << json_string(counter_names[c]) << ":" << counter_total(c);
+	}
+	out << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+	out.close();
+	if (!out.good()) {
+		std::cerr << "can't write trace " << filename << "\n";
+		return false;
+	}
+	std::cerr << "# profile trace written to " << filename << std::endl;
+	return true;
+}
+
+struct ScopeSummary {
+	int order;
+	long calls;
+	int64_t total, max;
+};
+
+void profile_print_summary(std::ostream &s) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	// scopes with the same name are merged whatever thread ran them, in the order they were first recorded
+	std::map<std::string, ScopeSummary> scopes;
+	for (ProfileBuffer *b : registry) {
+		for (const ProfileEvent &e : b->events) {
+			std::map<std::string, ScopeSummary>::iterator it = scopes.find(e.name);
+			if (it==scopes.end()) {
+				ScopeSummary first = {(int)scopes.size(), 0, 0, 0};
+				it = scopes.insert(std::make_pair(std::string(e.name), first)).first;
+			}
+			it->second.calls++;
+			it->second.total += e.end-e.start;
+			it->second.max = std::max(it->second.max, e.end-e.start);
+		}
+	}
+	std::vector<std::pair<std::string, ScopeSummary> > rows(scopes.begin(), scopes.end());
+	std::sort(rows.begin(), rows.end(), [](const std::pair<std::string, ScopeSummary> &a, const std::pair<std::string, ScopeSummary> &b) {
+		return a.second.order<b.second.order;
+	});
+	char line[256];
+	snprintf(line, sizeof(line), "# %-28s %8s %12s %12s %12s", "stage", "calls", "total ms", "mean ms", "max ms");
+	s << line << "\n";
+	for (const std::pair<std::string, ScopeSummary> &r : rows) {
+		snprintf(line, sizeof(line), "# %-28s %8ld %12.3f %12.4f %12.4f", r.first.c_str(), r.second.calls,
+		         r.second.total/1e6, r.second.total/1e6/r.second.calls, r.second.max/1e6);
+		s << line << "\n";
+	}
+	for (int c=0; c<PROFILE_NCOUNTERS; c++) {
+		snprintf(line, sizeof(line), "# %-28s %12lld", counter_names[c], (long long)counter_total(c));
+		s << line << "\n";
+	}
+	s.flush();
+}
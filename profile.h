@@ -0,0 +1,64 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+enum ProfileCounter {
+	COUNT_TRIANGLES_IN,     // primitives entering assembly
+	COUNT_TRIANGLES_CULLED, // back-facing or outside the frustum
+	COUNT_PIXELS_TESTED,    // covered pixels reaching the depth test
+	COUNT_PIXELS_PASSED,    // pixels passing it
+	COUNT_FRAGMENTS_SHADED, // colours computed: the passing pixels, the visible ones when deferred
+	COUNT_TEXELS_FETCHED,   // texels read to colour them (4 per bilinear sample, 8 per trilinear)
+	COUNT_BYTES_WRITTEN,    // TGA output
+	PROFILE_NCOUNTERS
+};
+
+// Frame instrumentation: scoped timers and counters, off until profile_enable(). Every thread
+// records into its own buffer, so nothing is shared or locked on the hot path; when disabled a
+// scope or a counter costs one relaxed load and a predictable branch. Hot loops count into
+// locals and add them once per triangle. Build with -DNO_PROFILE to compile it all out.
+// The export functions read every buffer and must run once the instrumented work is finished.
+#ifndef NO_PROFILE
+extern std::atomic<bool> profile_on;
+inline bool profiling() { return profile_on.load(std::memory_order_relaxed); }
+#else
+inline bool profiling() { return false; }
+#endif
+
+void profile_enable(bool on);
+int64_t profile_now(); // ns since the first profile_enable(true)
+void profile_event(const char *name, int64_t start, int64_t end);
+void profile_add(ProfileCounter c, long n);
+
+inline void profile_count(ProfileCounter c, long n) {
+	if (profiling()) profile_add(c, n);
+}
+
+// records the lifetime of the object as an event named name (a string literal)
+class ProfileScope {
+private:
+	const char *name_;
+	int64_t start_;
+public:
+	ProfileScope(const char *name) : name_(name), start_(profiling() ? profile_now() : -1) {}
+	~ProfileScope() { if (start_>=0) profile_event(name_, start_, profile_now()); }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#ifndef NO_PROFILE
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+// Chrome trace event format (chrome://tracing, Perfetto): one complete event per scope on the
+// thread that ran it, counter totals at the end
+bool profile_write_trace(const char *filename);
+// per scope name: calls, total, mean and max time; then the counters
+void profile_print_summary(std::ostream &s);
+
+#endif //__PROFILE_H__
@@ -0,0 +1,261 @@
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include "rasterizer.h"
+#include "profile.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RASTER_X86 1
+#endif
+
+// The block kernels keep edge values in 32-bit lanes. Edge functions are affine, so it is enough
+// to check the corners of the (block-padded) bounding box.
+static bool fits_int32(const EdgeTriangle &e, int pad) {
+	const int64_t lim = (int64_t(1)<<31) - 1;
+	int64_t w = e.bboxmax.x-e.bboxmin.x + pad;
+	int64_t h = e.bboxmax.y-e.bboxmin.y + 1;
+	for (int i=0; i<3; i++) {
+		for (int c=0; c<4; c++) {
+			int64_t v = e.row[i] + (c&1 ? w*e.stepx[i] : 0) + (c&2 ? h*e.stepy[i] : 0);
+			if (v>lim || v<-lim) return false;
+		}
+	}
+	return true;
+}
+
+// Copies diffuse texels straight into the framebuffer, skipping the TGAColor round trip of
+// image.set(model.diffuse(uv)) when both images share a pixel format. Same result either way.
+// Filtered samples are packed BGRA words, written as their first bpp bytes (little endian).
+struct TexelWriter {
+	TGAImage &image;
+	Model &model;
+	const Texture &filtered;
+	TextureFilter filter;
+	QuadLod lod;
+	unsigned char *pixels;
+	const unsigned char *texels;
+	int width, bpp, tw, th;
+	float twf, thf;
+	bool direct;
+	TexelWriter(TGAImage &img, Model &m, const EdgeTriangle &e) : image(img), model(m), filtered(m.diffuse_texture()), filter(m.texture_filter()), lod(e, m) {
+		TGAImage &tex = m.diffuse_map();
+		pixels = img.buffer();
+		texels = tex.buffer();
+		width  = img.get_width();
+		bpp    = img.get_bytespp();
+		tw     = tex.get_width();
+		th     = tex.get_height();
+		twf    = float(tw);
+		thf    = float(th);
+		if (filter==FILTER_POINT) direct = texels && tex.get_bytespp()==bpp;
+		else direct = bpp==TGAImage::RGB || bpp==TGAImage::RGBA;
+	}
+	inline void put(int x, int y, int tx, int ty, float u, float v) {
+		if (!direct) {
+			image.set(x, y, model.diffuse(Vec2f(u, v), lod(x, y)));
+			return;
+		}
+		unsigned char *dst = pixels+(x+y*width)*bpp;
+		if (filter!=FILTER_POINT) {
+			uint32_t c = filtered.sample(u, v, lod(x, y), filter);
+			memcpy(dst, &c, bpp);
+		} else if (tx<0 || ty<0 || tx>=tw || ty>=th) {
+			memset(dst, 0, bpp);
+		} else {
+			memcpy(dst, texels+(tx+ty*tw)*bpp, bpp);
+		}
+	}
+};
+
+#ifdef RASTER_X86
+
+__attribute__((target("avx2")))
+static void edge_kernel_avx2(const EdgeTriangle &e, TGAImage &image, float *zbuffer, Model &model) {
+	int width = image.get_width();
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i stepx8[3], bias[3], row[3];
+	for (int i=0; i<3; i++) {
+		stepx8[i] = _mm256_set1_epi32(int(e.stepx[i]*8));
+		bias[i]   = _mm256_set1_epi32(int(e.bias[i]));
+		row[i]    = _mm256_add_epi32(_mm256_set1_epi32(int(e.row[i])), _mm256_mullo_epi32(lane, _mm256_set1_epi32(int(e.stepx[i]))));
+	}
+	const __m256 inv_area = _mm256_set1_ps(e.inv_area);
+	const __m256 z0 = _mm256_set1_ps(e.z[0]), z1 = _mm256_set1_ps(e.z[1]), z2 = _mm256_set1_ps(e.z[2]);
+	// uv/w and 1/w of the corners, interpolated linearly and divided per pixel
+	const __m256 u0 = _mm256_set1_ps(e.uv[0].x*e.invw[0]), u1 = _mm256_set1_ps(e.uv[1].x*e.invw[1]), u2 = _mm256_set1_ps(e.uv[2].x*e.invw[2]);
+	const __m256 v0 = _mm256_set1_ps(e.uv[0].y*e.invw[0]), v1 = _mm256_set1_ps(e.uv[1].y*e.invw[1]), v2 = _mm256_set1_ps(e.uv[2].y*e.invw[2]);
+	const __m256 q0 = _mm256_set1_ps(e.invw[0]), q1 = _mm256_set1_ps(e.invw[1]), q2 = _mm256_set1_ps(e.invw[2]);
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256i lastx = _mm256_set1_epi32(e.bboxmax.x);
+	const __m256i minus1 = _mm256_set1_epi32(-1);
+	TexelWriter out(image, model, e);
+	const __m256 tw = _mm256_set1_ps(out.twf), th = _mm256_set1_ps(out.thf);
+	float us[8], vs[8];
+	int tx[8], ty[8];
+	const bool counting = profiling();
+	long tested = 0, passed = 0;
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		__m256i w0 = row[0], w1 = row[1], w2 = row[2];
+		for (int px=e.bboxmin.x; px<=e.bboxmax.x; px+=8) {
+			__m256i inside = _mm256_cmpgt_epi32(_mm256_or_si256(w0, _mm256_or_si256(w1, w2)), minus1);
+			__m256i valid  = _mm256_cmpgt_epi32(_mm256_add_epi32(lastx, _mm256_set1_epi32(1)), _mm256_add_epi32(lane, _mm256_set1_epi32(px)));
+			__m256i m = _mm256_and_si256(inside, valid);
+			if (!_mm256_testz_si256(m, m)) {
+				// undo the fill rule bias before weighting the vertices
+				__m256 l0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(w0, bias[0])), inv_area);
+				__m256 l1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(w1, bias[1])), inv_area);
+				__m256 l2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(w2, bias[2])), inv_area);
+				__m256 pz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(l0, z0), _mm256_mul_ps(l1, z1)), _mm256_mul_ps(l2, z2));
+				float *zrow = zbuffer+px+py*width;
+				// masked accesses never touch pixels outside the clip rectangle (another tile's)
+				__m256 zb = _mm256_maskload_ps(zrow, m);
+				__m256i pass = _mm256_and_si256(m, _mm256_castps_si256(_mm256_cmp_ps(zb, pz, _CMP_LT_OQ)));
+				int bits = _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+				if (counting) {
+					tested += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+					passed += __builtin_popcount(bits);
+				}
+				if (bits) {
+					_mm256_maskstore_ps(zrow, pass, pz);
+					__m256 r = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(l0, q0), _mm256_mul_ps(l1, q1)), _mm256_mul_ps(l2, q2)));
+					__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(l0, u0), _mm256_mul_ps(l1, u1)), _mm256_mul_ps(l2, u2)), r);
+					__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(l0, v0), _mm256_mul_ps(l1, v1)), _mm256_mul_ps(l2, v2)), r);
+					_mm256_storeu_ps(us, u);
+					_mm256_storeu_ps(vs, v);
+					_mm256_storeu_si256((__m256i *)tx, _mm256_cvttps_epi32(_mm256_mul_ps(u, tw)));
+					_mm256_storeu_si256((__m256i *)ty, _mm256_cvttps_epi32(_mm256_mul_ps(v, th)));
+					while (bits) {
+						int k = __builtin_ctz(bits);
+						bits &= bits-1;
+						out.put(px+k, py, tx[k], ty[k], us[k], vs[k]);
+					}
+				}
+			}
+			w0 = _mm256_add_epi32(w0, stepx8[0]);
+			w1 = _mm256_add_epi32(w1, stepx8[1]);
+			w2 = _mm256_add_epi32(w2, stepx8[2]);
+		}
+		for (int i=0; i<3; i++) row[i] = _mm256_add_epi32(row[i], _mm256_set1_epi32(int(e.stepy[i])));
+	}
+	count_pixels(tested, passed, model);
+}
+
+// SSE2 has no masked loads/stores, so only blocks lying completely inside the bounding box are
+// vectorized and the remainder of each span goes through the scalar code.
+static void edge_kernel_sse2(const EdgeTriangle &e, TGAImage &image, float *zbuffer, Model &model) {
+	int width = image.get_width();
+	const __m128i minus1 = _mm_set1_epi32(-1);
+	const __m128 inv_area = _mm_set1_ps(e.inv_area);
+	const __m128 z0 = _mm_set1_ps(e.z[0]), z1 = _mm_set1_ps(e.z[1]), z2 = _mm_set1_ps(e.z[2]);
+	const __m128 u0 = _mm_set1_ps(e.uv[0].x*e.invw[0]), u1 = _mm_set1_ps(e.uv[1].x*e.invw[1]), u2 = _mm_set1_ps(e.uv[2].x*e.invw[2]);
+	const __m128 v0 = _mm_set1_ps(e.uv[0].y*e.invw[0]), v1 = _mm_set1_ps(e.uv[1].y*e.invw[1]), v2 = _mm_set1_ps(e.uv[2].y*e.invw[2]);
+	const __m128 q0 = _mm_set1_ps(e.invw[0]), q1 = _mm_set1_ps(e.invw[1]), q2 = _mm_set1_ps(e.invw[2]);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128i bias[3];
+	for (int i=0; i<3; i++) bias[i] = _mm_set1_epi32(int(e.bias[i]));
+	TexelWriter out(image, model, e);
+	const __m128 tw = _mm_set1_ps(out.twf), th = _mm_set1_ps(out.thf);
+	float us[4], vs[4];
+	int tx[4], ty[4];
+	int64_t row[3] = {e.row[0], e.row[1], e.row[2]};
+	const bool counting = profiling();
+	long tested = 0, passed = 0;
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		int px = e.bboxmin.x;
+		int32_t w[3] = {int32_t(row[0]), int32_t(row[1]), int32_t(row[2])};
+		for (; px+3<=e.bboxmax.x; px+=4) {
+			__m128i w0 = _mm_add_epi32(_mm_set1_epi32(w[0]), _mm_set_epi32(int(3*e.stepx[0]), int(2*e.stepx[0]), int(e.stepx[0]), 0));
+			__m128i w1 = _mm_add_epi32(_mm_set1_epi32(w[1]), _mm_set_epi32(int(3*e.stepx[1]), int(2*e.stepx[1]), int(e.stepx[1]), 0));
+			__m128i w2 = _mm_add_epi32(_mm_set1_epi32(w[2]), _mm_set_epi32(int(3*e.stepx[2]), int(2*e.stepx[2]), int(e.stepx[2]), 0));
+			for (int i=0; i<3; i++) w[i] += int32_t(4*e.stepx[i]);
+			__m128i m = _mm_cmpgt_epi32(_mm_or_si128(w0, _mm_or_si128(w1, w2)), minus1);
+			if (!_mm_movemask_ps(_mm_castsi128_ps(m))) continue;
+			__m128 l0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(w0, bias[0])), inv_area);
+			__m128 l1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(w1, bias[1])), inv_area);
+			__m128 l2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(w2, bias[2])), inv_area);
+			__m128 pz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, z0), _mm_mul_ps(l1, z1)), _mm_mul_ps(l2, z2));
+			float *zrow = zbuffer+px+py*width;
+			__m128 zb = _mm_loadu_ps(zrow);
+			__m128 pass = _mm_and_ps(_mm_castsi128_ps(m), _mm_cmplt_ps(zb, pz));
+			int bits = _mm_movemask_ps(pass);
+			if (counting) {
+				tested += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+				passed += __builtin_popcount(bits);
+			}
+			if (!bits) continue;
+			_mm_storeu_ps(zrow, _mm_or_ps(_mm_and_ps(pass, pz), _mm_andnot_ps(pass, zb)));
+			__m128 r = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, q0), _mm_mul_ps(l1, q1)), _mm_mul_ps(l2, q2)));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, u0), _mm_mul_ps(l1, u1)), _mm_mul_ps(l2, u2)), r);
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, v0), _mm_mul_ps(l1, v1)), _mm_mul_ps(l2, v2)), r);
+			_mm_storeu_ps(us, u);
+			_mm_storeu_ps(vs, v);
+			_mm_storeu_si128((__m128i *)tx, _mm_cvttps_epi32(_mm_mul_ps(u, tw)));
+			_mm_storeu_si128((__m128i *)ty, _mm_cvttps_epi32(_mm_mul_ps(v, th)));
+			while (bits) {
+				int k = __builtin_ctz(bits);
+				bits &= bits-1;
+				out.put(px+k, py, tx[k], ty[k], us[k], vs[k]);
+			}
+		}
+		if (px<=e.bboxmax.x) {
+			EdgeTriangle tail = e;
+			tail.bboxmin = Vec2i(px, py);
+			tail.bboxmax.y = py;
+			for (int i=0; i<3; i++) tail.row[i] = w[i];
+			edge_kernel_scalar(tail, image, zbuffer, model);
+		}
+		for (int i=0; i<3; i++) row[i] += e.stepy[i];
+	}
+	count_pixels(tested, passed, model);
+}
+
+#endif // RASTER_X86
+
+enum SimdKernel { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+static SimdKernel detect_kernel() {
+#ifdef RASTER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return KERNEL_AVX2;
+	if (__builtin_cpu_supports("sse2")) return KERNEL_SSE2;
+#endif
+	return KERNEL_SCALAR;
+}
+
+static const SimdKernel detected_kernel = detect_kernel();
+static SimdKernel simd_kernel = detected_kernel;
+
+bool set_simd_kernel(const char *name) {
+	std::string n(name);
+	if (n=="scalar")                                          simd_kernel = KERNEL_SCALAR;
+	else if (n=="sse2" && detected_kernel>=KERNEL_SSE2) simd_kernel = KERNEL_SSE2;
+	else if (n=="avx2" && detected_kernel>=KERNEL_AVX2) simd_kernel = KERNEL_AVX2;
+	else return false;
+	return true;
+}
+
+const char *simd_kernel_name() {
+	switch (simd_kernel) {
+		case KERNEL_AVX2: return "avx2";
+		case KERNEL_SSE2: return "sse2";
+		default:          return "scalar";
+	}
+}
+
+void triangle_simd(const ScreenTriangle &t, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax) {
+	EdgeTriangle e;
+	if (!setup_edges(t, clipmin, clipmax, e)) return;
+#ifdef RASTER_X86
+	if (simd_kernel==KERNEL_AVX2 && fits_int32(e, 8)) {
+		edge_kernel_avx2(e, image, zbuffer, model);
+		return;
+	}
+	if (simd_kernel!=KERNEL_SCALAR && fits_int32(e, 4)) {
+		edge_kernel_sse2(e, image, zbuffer, model);
+		return;
+	}
+#endif
+	edge_kernel_scalar(e, image, zbuffer, model);
+}
@@ -0,0 +1,315 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include "rasterizer.h"
+#include "profile.h"
+
+Vec3f barycentric(Vec3i pts[3], Vec3f P) {
+	// S = <up, vp, s>
+	Vec3f S =
+		Vec3f(pts[2].x - pts[0].x,
+			  pts[1].x - pts[0].x,
+			  pts[0].x - P.x) ^
+		Vec3f(pts[2].y - pts[0].y,
+			  pts[1].y - pts[0].y,
+			  pts[0].y - P.y);
+	double up, vp, s, u, v;
+	up = S.x; vp = S.y; s = S.z;
+	// P = (1-u-v)*A + v*B + u*C
+	u = up / s; v = vp / s;
+	if (std::abs(s) > .01) {
+		// due to floating point precision: 1.-(up+vp)/s != 1.-u-v
+		return Vec3f(1.-u-v, v, u);
+	}
+	// degenerate case
+	return Vec3f(-1,-1,-1);
+}
+
+void count_pixels(long tested, long passed, Model &model) {
+	if (!profiling()) return;
+	profile_add(COUNT_PIXELS_TESTED, tested);
+	profile_add(COUNT_PIXELS_PASSED, passed);
+	profile_add(COUNT_FRAGMENTS_SHADED, passed);
+	profile_add(COUNT_TEXELS_FETCHED, passed*filter_taps(model.texture_filter()));
+}
+
+void triangle(Vec3i pts[3], Vec2f uvs[3], const float invw[3], TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax) {
+	int width = image.get_width();
+	Vec2i bboxmin( std::numeric_limits<int>::max(),  std::numeric_limits<int>::max());
+	Vec2i bboxmax(-std::numeric_limits<int>::max(), -std::numeric_limits<int>::max());
+	for (int i=0; i<3; i++) {
+		for (int j=0; j<2; j++) {
+			bboxmin[j] = std::max(clipmin[j], std::min(bboxmin[j], pts[i][j]));
+			bboxmax[j] = std::min(clipmax[j], std::max(bboxmax[j], pts[i][j]));
+		}
+	}
+	QuadLod lod(pts, uvs, invw, model);
+	// P in ABC iff u,v,(1-u-v) \in [0,1]
+	long tested = 0, passed = 0;
+	Vec3f P;
+	for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
+		for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
+			Vec3f bc_screen = barycentric(pts, P);
+			// leniancy for floating point error
+			float err = -.001;
+			if (bc_screen.x<err || bc_screen.y<err || bc_screen.z<err) continue;
+			P.z = 0;
+			for (int i=0; i<3; i++) P.z += pts[i].z*bc_screen[i];
+			tested++;
+			if (zbuffer[int(P.x+P.y*width)]<P.z) {
+				passed++;
+				zbuffer[int(P.x+P.y*width)] = P.z;
+				// uv/w and 1/w are linear in screen space, uv is not
+				Vec2f uvP(0,0);
+				float iw = 0;
+				for (int i=0; i<3; i++) {
+					float l = bc_screen[i]*invw[i];
+					uvP.x += uvs[i].x*l;
+					uvP.y += uvs[i].y*l;
+					iw += l;
+				}
+				uvP = uvP*(1.f/iw);
+				TGAColor color = model.diffuse(uvP, lod(P.x, P.y));
+				image.set(P.x, P.y, color);
+			}
+		}
+	}
+	count_pixels(tested, passed, model);
+}
+
+void triangle(Vec3i pts[3], Vec2f uvs[3], const float invw[3], TGAImage &image, float *zbuffer, Model &model) {
+	triangle(pts, uvs, invw, image, zbuffer, model, Vec2i(0, 0), Vec2i(image.get_width()-1, image.get_height()-1));
+}
+
+static inline int64_t floor_div(int64_t a, int64_t b) {
+	return a>=0 ? a/b : -((-a+b-1)/b);
+}
+
+// An edge owns the pixels lying exactly on it when it is a top or a left edge (y grows with the
+// row index). Two triangles sharing an edge walk it in opposite directions, so exactly one owns it.
+static inline bool top_left(int64_t dx, int64_t dy) {
+	return dy<0 || (dy==0 && dx>0);
+}
+
+bool setup_edges(const Vec3f pts[3], Vec2i clipmin, Vec2i clipmax, EdgeTriangle &e, int pad) {
+	const int64_t one = 1<<SUBPIXEL_BITS;
+	const float limit = float(1<<22); // keeps the edge products well inside 64 bits
+	int64_t *x = e.x, *y = e.y;
+	for (int i=0; i<3; i++) {
+		if (std::abs(pts[i].x)>limit || std::abs(pts[i].y)>limit) return false;
+		x[i]    = (int64_t)std::lround(pts[i].x*one);
+		y[i]    = (int64_t)std::lround(pts[i].y*one);
+		e.z[i]  = pts[i].z;
+	}
+	int64_t area = (x[1]-x[0])*(y[2]-y[0]) - (y[1]-y[0])*(x[2]-x[0]);
+	if (area==0) return false;
+	e.flipped = area<0;
+	if (e.flipped) { // make the interior lie on the left of every edge
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(e.z[1], e.z[2]);
+		area = -area;
+	}
+	e.bboxmin.x = std::max<int64_t>(clipmin.x, floor_div(std::min(x[0], std::min(x[1], x[2]))-pad+one-1, one));
+	e.bboxmin.y = std::max<int64_t>(clipmin.y, floor_div(std::min(y[0], std::min(y[1], y[2]))-pad+one-1, one));
+	e.bboxmax.x = std::min<int64_t>(clipmax.x, floor_div(std::max(x[0], std::max(x[1], x[2]))+pad, one));
+	e.bboxmax.y = std::min<int64_t>(clipmax.y, floor_div(std::max(y[0], std::max(y[1], y[2]))+pad, one));
+	if (e.bboxmin.x>e.bboxmax.x || e.bboxmin.y>e.bboxmax.y) return false;
+
+	// edge i is opposite to vertex i, its value at P is the (doubled, scaled) area of the sub-triangle
+	for (int i=0; i<3; i++) {
+		int a = (i+1)%3, b = (i+2)%3;
+		int64_t dx = x[b]-x[a], dy = y[b]-y[a];
+		e.stepx[i] = -dy*one;
+		e.stepy[i] =  dx*one;
+		e.row[i] = dx*(e.bboxmin.y*one-y[a]) - dy*(e.bboxmin.x*one-x[a]);
+		e.bias[i] = top_left(dx, dy) ? 0 : 1;
+		e.row[i] -= e.bias[i]; // w>=0 test becomes w>0 for edges we do not own
+	}
+	e.inv_area = 1.f/float(area);
+	return true;
+}
+
+bool setup_edges(const ScreenTriangle &t, Vec2i clipmin, Vec2i clipmax, EdgeTriangle &e) {
+	if (!setup_edges(t.pts, clipmin, clipmax, e)) return false;
+	e.uv[0] = t.uvs[0];
+	e.uv[1] = t.uvs[e.flipped ? 2 : 1];
+	e.uv[2] = t.uvs[e.flipped ? 1 : 2];
+	e.invw[0] = t.invw[0];
+	e.invw[1] = t.invw[e.flipped ? 2 : 1];
+	e.invw[2] = t.invw[e.flipped ? 1 : 2];
+	return true;
+}
+
+QuadLod::QuadLod(const EdgeTriangle &e, Model &model) {
+	const float one = float(1<<SUBPIXEL_BITS);
+	float x[3], y[3];
+	for (int i=0; i<3; i++) {
+		x[i] = e.x[i]/one;
+		y[i] = e.y[i]/one;
+	}
+	setup(x, y, e.uv, e.invw, model);
+}
+
+QuadLod::QuadLod(Vec3i pts[3], const Vec2f uv[3], const float invw[3], Model &model) {
+	float x[3] = {float(pts[0].x), float(pts[1].x), float(pts[2].x)};
+	float y[3] = {float(pts[0].y), float(pts[1].y), float(pts[2].y)};
+	setup(x, y, uv, invw, model);
+}
+
+void QuadLod::setup(const float x[3], const float y[3], const Vec2f uv[3], const float invw[3], Model &model) {
+	texture_ = NULL;
+	qx_ = qy_ = -1;
+	lod_ = 0;
+	float e1x = x[1]-x[0], e1y = y[1]-y[0], e2x = x[2]-x[0], e2y = y[2]-y[0];
+	float area = e1x*e2y - e1y*e2x;
+	if (model.texture_filter()==FILTER_POINT || area==0) return;
+	texture_ = &model.diffuse_texture();
+	x0_ = x[0];
+	y0_ = y[0];
+	for (int k=0; k<3; k++) {
+		float f[3];
+		for (int i=0; i<3; i++) f[i] = k==2 ? invw[i] : (k ? uv[i].y : uv[i].x)*invw[i];
+		float d1 = f[1]-f[0], d2 = f[2]-f[0];
+		f_[k]  = f[0];
+		dx_[k] = (d1*e2y - d2*e1y)/area;
+		dy_[k] = (d2*e1x - d1*e2x)/area;
+	}
+	qmin_ = std::min(invw[0], std::min(invw[1], invw[2]));
+	qmax_ = std::max(invw[0], std::max(invw[1], invw[2]));
+}
+
+void QuadLod::update(int qx, int qy) {
+	qx_ = qx;
+	qy_ = qy;
+	// the top left pixel of the quad, then the ones right of and below it
+	float px = float(2*qx) - x0_, py = float(2*qy) - y0_;
+	float uw = f_[0] + dx_[0]*px + dy_[0]*py, vw = f_[1] + dx_[1]*px + dy_[1]*py, q = f_[2] + dx_[2]*px + dy_[2]*py;
+	float r  = 1.f/std::min(qmax_, std::max(qmin_, q));
+	float rx = 1.f/std::min(qmax_, std::max(qmin_, q+dx_[2]));
+	float ry = 1.f/std::min(qmax_, std::max(qmin_, q+dy_[2]));
+	float u = uw*r, v = vw*r;
+	lod_ = texture_->lod((uw+dx_[0])*rx-u, (vw+dx_[1])*rx-v, (uw+dy_[0])*ry-u, (vw+dy_[1])*ry-v);
+}
+
+void edge_kernel_scalar(const EdgeTriangle &e, TGAImage &image, float *zbuffer, Model &model) {
+	int width = image.get_width();
+	QuadLod lod(e, model);
+	float uw[3], vw[3];
+	for (int i=0; i<3; i++) {
+		uw[i] = e.uv[i].x*e.invw[i];
+		vw[i] = e.uv[i].y*e.invw[i];
+	}
+	int64_t row[3] = {e.row[0], e.row[1], e.row[2]};
+	long tested = 0, passed = 0;
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+		for (int px=e.bboxmin.x; px<=e.bboxmax.x; px++) {
+			if ((w0|w1|w2)>=0) {
+				// undo the fill rule bias before weighting the vertices
+				float l0 = float(w0+e.bias[0])*e.inv_area;
+				float l1 = float(w1+e.bias[1])*e.inv_area;
+				float l2 = float(w2+e.bias[2])*e.inv_area;
+				float pz = l0*e.z[0] + l1*e.z[1] + l2*e.z[2];
+				int idx = px+py*width;
+				tested++;
+				if (zbuffer[idx]<pz) {
+					passed++;
+					zbuffer[idx] = pz;
+					// perspective-correct: uv/w and 1/w are linear in screen space
+					float r = 1.f/(l0*e.invw[0] + l1*e.invw[1] + l2*e.invw[2]);
+					Vec2f uvP((l0*uw[0] + l1*uw[1] + l2*uw[2])*r, (l0*vw[0] + l1*vw[1] + l2*vw[2])*r);
+					image.set(px, py, model.diffuse(uvP, lod(px, py)));
+				}
+			}
+			w0 += e.stepx[0]; w1 += e.stepx[1]; w2 += e.stepx[2];
+		}
+		for (int i=0; i<3; i++) row[i] += e.stepy[i];
+	}
+	count_pixels(tested, passed, model);
+}
+
+void triangle_edge(const ScreenTriangle &t, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax) {
+	EdgeTriangle e;
+	if (setup_edges(t, clipmin, clipmax, e)) {
+		edge_kernel_scalar(e, image, zbuffer, model);
+	}
+}
+
+// depth test and write, and the triangle id when ids is not NULL
+template <bool WriteIds> static long depth_kernel(const Vec3f pts[3], int id, float *zbuffer, int *ids, int width, Vec2i clipmin, Vec2i clipmax) {
+	EdgeTriangle e;
+	if (!setup_edges(pts, clipmin, clipmax, e)) return 0;
+	int64_t row[3] = {e.row[0], e.row[1], e.row[2]};
+	long tested = 0, passed = 0;
+	for (int py=e.bboxmin.y; py<=e.bboxmax.y; py++) {
+		int64_t w0 = row[0], w1 = row[1], w2 = row[2];
+		float *zrow = zbuffer+py*width;
+		for (int px=e.bboxmin.x; px<=e.bboxmax.x; px++) {
+			if ((w0|w1|w2)>=0) {
+				// the expression of the shaded kernels, for the same depth values
+				float l0 = float(w0+e.bias[0])*e.inv_area;
+				float l1 = float(w1+e.bias[1])*e.inv_area;
+				float l2 = float(w2+e.bias[2])*e.inv_area;
+				float pz = l0*e.z[0] + l1*e.z[1] + l2*e.z[2];
+				tested++;
+				if (zrow[px]<pz) {
+					passed++;
+					zrow[px] = pz;
+					if (WriteIds) ids[px+py*width] = id;
+				}
+			}
+			w0 += e.stepx[0]; w1 += e.stepx[1]; w2 += e.stepx[2];
+		}
+		for (int i=0; i<3; i++) row[i] += e.stepy[i];
+	}
+	if (profiling()) {
+		profile_add(COUNT_PIXELS_TESTED, tested);
+		profile_add(COUNT_PIXELS_PASSED, passed);
+	}
+	return passed;
+}
+
+long triangle_depth(const Vec3f pts[3], float *zbuffer, int width, Vec2i clipmin, Vec2i clipmax) {
+	return depth_kernel<false>(pts, 0, zbuffer, NULL, width, clipmin, clipmax);
+}
+
+long triangle_visibility(const Vec3f pts[3], int id, float *zbuffer, int *ids, int width, Vec2i clipmin, Vec2i clipmax) {
+	return depth_kernel<true>(pts, id, zbuffer, ids, width, clipmin, clipmax);
+}
+
+void bounding_box(const ScreenTriangle &t, Vec2i &bboxmin, Vec2i &bboxmax) {
+	bounding_box(t.pts, bboxmin, bboxmax);
+}
+
+void bounding_box(const Vec3f pts[3], Vec2i &bboxmin, Vec2i &bboxmax) {
+	float minx = pts[0].x, miny = pts[0].y, maxx = minx, maxy = miny;
+	for (int i=1; i<3; i++) {
+		minx = std::min(minx, pts[i].x);
+		miny = std::min(miny, pts[i].y);
+		maxx = std::max(maxx, pts[i].x);
+		maxy = std::max(maxy, pts[i].y);
+	}
+	const float limit = float(std::numeric_limits<int>::max()/2);
+	bboxmin = Vec2i(std::floor(std::max(minx, -limit)), std::floor(std::max(miny, -limit)));
+	bboxmax = Vec2i(std::ceil (std::min(maxx,  limit)), std::ceil (std::min(maxy,  limit)));
+}
+
+void rasterize(const ScreenTriangle &t, RasterMode mode, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax) {
+	if (mode==RASTER_EDGE) {
+		triangle_edge(t, image, zbuffer, model, clipmin, clipmax);
+		return;
+	}
+	if (mode==RASTER_SIMD) {
+		triangle_simd(t, image, zbuffer, model, clipmin, clipmax);
+		return;
+	}
+	Vec3i pts[3];
+	Vec2f uvs[3];
+	for (int i=0; i<3; i++) {
+		pts[i] = t.pts[i];
+		uvs[i] = t.uvs[i];
+	}
+	triangle(pts, uvs, t.invw, image, zbuffer, model, clipmin, clipmax);
+}
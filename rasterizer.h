@@ -0,0 +1,113 @@
+#ifndef __RASTERIZER_H__
+#define __RASTERIZER_H__
+
+#include <cstdint>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "model.h"
+
+struct ScreenTriangle {
+	Vec3f pts[3]; // viewport coordinates, kept unrounded for the sub-pixel rasterizer
+	Vec2f uvs[3];
+	float invw[3]; // 1/w of the corners, the uvs are interpolated perspective-correct with them
+};
+
+const int MAX_VARYINGS = 16;
+
+// How the varyings of a shader are laid out: perspective-correct ones first, then the ones
+// interpolated linearly in screen space, then the flat ones (taken from corner 0), all contiguous.
+struct VaryingLayout {
+	int perspective;
+	int linear;
+	int flat;
+	int count() const { return perspective+linear+flat; }
+};
+
+// triangle of the programmable pipeline (see pipeline.h), varyings[i] are the vertex shader
+// outputs of corner i
+struct ShadedTriangle {
+	Vec3f pts[3];
+	float invw[3]; // 1/w of the corners, weights of the perspective-correct interpolation
+	float varyings[3][MAX_VARYINGS];
+};
+
+// triangle of a depth-only pass (shadow maps), nothing but the positions
+struct DepthTriangle {
+	Vec3f pts[3];
+};
+
+enum RasterMode {
+	RASTER_BARYCENTRIC, // per-pixel barycentric() on integer-snapped vertices
+	RASTER_EDGE,        // incremental fixed-point edge functions with the top-left fill rule
+	RASTER_SIMD         // RASTER_EDGE evaluated on 8x1 (AVX2) or 4x1 (SSE2) pixel blocks, same output
+};
+
+const int SUBPIXEL_BITS = 4;
+
+// triangle set up for edge-function rasterization, shared by the scalar and the SIMD kernels
+struct EdgeTriangle {
+	int64_t x[3], y[3];    // fixed-point vertices, counter-clockwise
+	float z[3];
+	Vec2f uv[3];
+	float invw[3];          // 1/w of the corners, uv/w and 1/w are interpolated and divided per pixel
+	Vec2i bboxmin, bboxmax; // pixel bounding box, already clipped
+	int64_t row[3];         // biased edge values at bboxmin
+	int64_t stepx[3], stepy[3];
+	int64_t bias[3];        // 1 for edges not owned under the top-left rule
+	float inv_area;
+	bool flipped;           // corners 1 and 2 were swapped to make the triangle counter-clockwise
+};
+
+Vec3f barycentric(Vec3i pts[3], Vec3f P);
+// fills the part of the triangle lying inside [clipmin, clipmax] (both inclusive), invw the 1/w of
+// the corners for the perspective-correct uvs
+void triangle(Vec3i pts[3], Vec2f uvs[3], const float invw[3], TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax);
+void triangle(Vec3i pts[3], Vec2f uvs[3], const float invw[3], TGAImage &image, float *zbuffer, Model &model);
+bool setup_edges(const ScreenTriangle &t, Vec2i clipmin, Vec2i clipmax, EdgeTriangle &e);
+// same without the uvs, e.uv and e.invw are left untouched; pad (sub-pixel units) grows the
+// bounding box for samples that lie off the pixel centres
+bool setup_edges(const Vec3f pts[3], Vec2i clipmin, Vec2i clipmax, EdgeTriangle &e, int pad=0);
+void edge_kernel_scalar(const EdgeTriangle &e, TGAImage &image, float *zbuffer, Model &model);
+void triangle_edge(const ScreenTriangle &t, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax);
+void triangle_simd(const ScreenTriangle &t, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax);
+// Depth-only fill with the RASTER_EDGE coverage: the depth test and write, no varyings, texture
+// or colour. zbuffer is width pixels wide; returns the number of depth values written.
+long triangle_depth(const Vec3f pts[3], float *zbuffer, int width, Vec2i clipmin, Vec2i clipmax);
+// the same, also storing id where the depth is written: the G-buffer of the deferred mode
+long triangle_visibility(const Vec3f pts[3], int id, float *zbuffer, int *ids, int width, Vec2i clipmin, Vec2i clipmax);
+// Level of detail of the diffuse texture per 2x2 pixel quad, as a GPU takes it: the derivatives
+// are the differences of the perspective-correct uvs at three pixels of the quad, so it changes
+// along a foreshortened triangle. u/w, v/w and 1/w are planes over the pixel grid; the last quad
+// is kept, the kernels walk rows and ask for each quad twice. Always 0 when the model does not
+// filter.
+class QuadLod {
+private:
+	const Texture *texture_;     // NULL for FILTER_POINT
+	float x0_, y0_;              // corner 0, the planes are relative to it
+	float f_[3], dx_[3], dy_[3]; // u/w, v/w and 1/w at corner 0 and their steps per pixel
+	float qmin_, qmax_;          // range of 1/w over the triangle, quads reach past its edges
+	int qx_, qy_;
+	float lod_;
+	void setup(const float x[3], const float y[3], const Vec2f uv[3], const float invw[3], Model &model);
+	void update(int qx, int qy);
+public:
+	QuadLod(const EdgeTriangle &e, Model &model);
+	QuadLod(Vec3i pts[3], const Vec2f uv[3], const float invw[3], Model &model);
+	inline float operator()(int px, int py) {
+		if (!texture_) return 0;
+		if ((px>>1)!=qx_ || (py>>1)!=qy_) update(px>>1, py>>1);
+		return lod_;
+	}
+};
+// adds the depth test outcomes of a triangle, and the texels they read, to the profile counters
+void count_pixels(long tested, long passed, Model &model);
+// widest block kernel usable on this CPU: "avx2", "sse2" or "scalar"
+const char *simd_kernel_name();
+// restricts triangle_simd() to a narrower kernel, false if the CPU cannot run the requested one
+bool set_simd_kernel(const char *name);
+// conservative pixel bounding box of t, valid for every raster mode
+void bounding_box(const ScreenTriangle &t, Vec2i &bboxmin, Vec2i &bboxmax);
+void bounding_box(const Vec3f pts[3], Vec2i &bboxmin, Vec2i &bboxmax);
+void rasterize(const ScreenTriangle &t, RasterMode mode, TGAImage &image, float *zbuffer, Model &model, Vec2i clipmin, Vec2i clipmax);
+
+#endif //__RASTERIZER_H__
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include "renderer.h"
+#include "shader.h"
+#include "pipeline.h"
+#include "profile.h"
+
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
+    Vec3f z = (eye-center).normalize();
+    Vec3f x = cross(up,z).normalize();
+    Vec3f y = cross(z,x).normalize();
+    Matrix Minv = Matrix::identity(4);
+    Matrix Tr = Matrix::identity(4);
+    for (int i=0; i<3; i++) {
+        Minv[0][i] = x[i];
+        Minv[1][i] = y[i];
+        Minv[2][i] = z[i];
+        Tr[i][3] = -center[i];
+    }
+    return Minv*Tr;
+}
+
+Matrix viewport(int x, int y, int w, int h) {
+    Matrix m = Matrix::identity(4);
+    m[0][3] = x+w/2.f;
+    m[1][3] = y+h/2.f;
+    m[2][3] = RENDER_DEPTH/2.f;
+
+    m[0][0] = w/2.f;
+    m[1][1] = h/2.f;
+    m[2][2] = RENDER_DEPTH/2.f;
+    return m;
+}
+
+Matrix supersampled_viewport(int w, int h, int factor) {
+    Matrix m = viewport(0, 0, factor*w, factor*h);
+    m[0][3] += (factor-1)/2.f;
+    m[1][3] += (factor-1)/2.f;
+    return m;
+}
+
+RenderSettings::RenderSettings() : width(800), height(800), nthreads(ThreadPool::default_threads()), mode(RASTER_SIMD),
+    use_hiz(true), winding(CULL_CW), shader(SHADER_NONE), light_dir(0, 0, -1), shadow_size(0),
+    deferred(false), ssao(false), msaa(false) {
+}
+
+RenderContext::RenderContext(Model &model, const RenderSettings &settings) : model_(model), settings_(settings),
+    image_(settings.width, settings.height, TGAImage::RGB), zbuffer_(settings.width*settings.height),
+    pool_(std::max(settings.nthreads, 1)), hiz_(settings.width, settings.height), tiler_(settings.width, settings.height),
+    vertices_(), culler_(settings.width, settings.height), tris_(), shaded_(), shadow_(settings.shadow_size), gbuffer_(),
+    ssao_(settings.width, settings.height), msaa_(), verbose_(false) {
+    culler_.set_winding(settings.winding);
+    if (settings.msaa) msaa_.resize(settings.width, settings.height);
+}
+
+const RenderSettings &RenderContext::settings() const {
+    return settings_;
+}
+
+void RenderContext::resize(int width, int height) {
+    settings_.width  = width;
+    settings_.height = height;
+    image_ = TGAImage(width, height, TGAImage::RGB);
+    zbuffer_.assign(width*height, 0.f);
+    hiz_.resize(width, height);
+    tiler_ = Tiler(width, height);
+    culler_ = PrimitiveCuller(width, height);
+    culler_.set_winding(settings_.winding);
+    ssao_.resize(width, height);
+    if (settings_.msaa) msaa_.resize(width, height);
+}
+
+void RenderContext::set_verbose(bool verbose) {
+    verbose_ = verbose;
+}
+
+ThreadPool &RenderContext::pool() {
+    return pool_;
+}
+
+mat4 RenderContext::camera_matrix(const CameraPose &pose) const {
+    Matrix Projection = Matrix::identity(4);
+    Projection[3][2] = -1.f/(pose.eye-pose.center).norm();
+    return mat4(viewport(0, 0, settings_.width, settings_.height))*mat4(Projection)*mat4(lookat(pose.eye, pose.center, pose.up));
+}
+
+void RenderContext::render(const CameraPose &pose) {
+    render(camera_matrix(pose), settings_.light_dir*-1.f, (pose.eye-pose.center).normalize(), image_);
+}
+
+// the programmable path with one of the built-in shaders, nthreads as for the fixed path
+template <class Shader> void RenderContext::render_program(Shader &shader, TGAImage &target) {
+    assemble_shaded(model_, shader, culler_, shaded_);
+    if (verbose_) culler_.print_stats(std::cerr);
+    Tiler *tiler = settings_.nthreads ? &tiler_ : NULL;
+    if (settings_.msaa) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        long fragments = render_msaa(shaded_, shader, msaa_, tiler, pool_);
+        std::chrono::steady_clock::time_point raster_end = std::chrono::steady_clock::now();
+        msaa_resolve(msaa_, target, zbuffer_.data(), pool_);
+        if (verbose_) {
+            double raster = std::chrono::duration<double, std::milli>(raster_end-start).count();
+            double resolve = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-raster_end).count();
+            std::cerr << "# msaa " << MSAA_SAMPLES << "x raster " << raster << " ms, " << fragments << " fragments shaded, resolve "
+                      << resolve << " ms, " << msaa_.bytes() << " bytes of samples" << std::endl;
+        }
+        return;
+    }
+    if (settings_.deferred) {
+        long fragments = render_deferred(shaded_, shader, target, zbuffer_.data(), gbuffer_, tiler, pool_);
+        if (verbose_) {
+            std::cerr << "# deferred gbuffer " << gbuffer_.raster_ms << " ms, " << gbuffer_.written << " depth writes; shading "
+                      << gbuffer_.shade_ms << " ms, " << fragments << " fragments shaded ("
+                      << double(gbuffer_.written)/std::max(fragments, 1L) << "x fewer than forward)" << std::endl;
+        }
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long fragments = render_shaded(shaded_, shader, target, zbuffer_.data(), tiler, pool_);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    if (verbose_) std::cerr << "# raster " << elapsed << " ms, " << fragments << " fragments shaded" << std::endl;
+}
+
+void RenderContext::render(const mat4 &MVP, Vec3f light, Vec3f view, TGAImage &target) {
+    PROFILE_SCOPE("frame");
+    int width = settings_.width, height = settings_.height;
+    {
+        PROFILE_SCOPE("clear");
+        target.clear();
+        std::fill(zbuffer_.begin(), zbuffer_.end(), -std::numeric_limits<float>::max());
+        hiz_.clear(-std::numeric_limits<float>::max());
+        if (settings_.msaa) msaa_.clear(pool_);
+    }
+    vertices_.transform(model_, MVP, pool_);
+    // the fixed path has no multisampled kernels, TexturedShader renders its image with point
+    // sampling: the shaders do not apply the model's texture filter
+    ShaderKind kind = settings_.shader==SHADER_NONE && settings_.msaa ? SHADER_TEXTURED : settings_.shader;
+    if (kind!=SHADER_NONE) {
+        // the shadow pass before the main one, skipped while the light stays where it was
+        const ShadowMap *shadow = NULL;
+        if (settings_.shadow_size>0 && (kind==SHADER_PHONG || kind==SHADER_MAPPED)) {
+            bool rendered = shadow_.update(model_, light*-1.f, pool_);
+            if (verbose_) {
+                if (rendered) shadow_.print_stats(std::cerr);
+                else std::cerr << "# shadow map reused" << std::endl;
+            }
+            shadow = &shadow_;
+        }
+        ShaderContext ctx(model_, vertices_, light, view, shadow);
+        switch (kind) {
+            case SHADER_FLAT: {
+                FlatShader flat(ctx);
+                render_program(flat, target);
+                break;
+            }
+            case SHADER_GOURAUD: {
+                GouraudShader gouraud(ctx);
+                render_program(gouraud, target);
+                break;
+            }
+            case SHADER_TEXTURED: {
+                TexturedShader textured(ctx);
+                render_program(textured, target);
+                break;
+            }
+            case SHADER_MAPPED: {
+                MappedShader mapped(ctx);
+                render_program(mapped, target);
+                break;
+            }
+            default: {
+                PhongShader phong(ctx);
+                render_program(phong, target);
+                break;
+            }
+        }
+        post_process(target);
+        return;
+    }
+    culler_.assemble(model_, vertices_, tris_);
+    if (verbose_) {
+        vertices_.print_stats(std::cerr);
+        culler_.print_stats(std::cerr);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float *zbuffer = zbuffer_.data();
+    if (settings_.nthreads==0) {
+        PROFILE_SCOPE("raster");
+        for (int i=0; i<(int)tris_.size(); i++) {
+            if (settings_.use_hiz) {
+                rasterize_hiz(tris_[i], settings_.mode, target, zbuffer, hiz_, model_, Vec2i(0, 0), Vec2i(width-1, height-1));
+            } else {
+                rasterize(tris_[i], settings_.mode, target, zbuffer, model_, Vec2i(0, 0), Vec2i(width-1, height-1));
+            }
+        }
+    } else {
+        tiler_.bin(tris_);
+        tiler_.render(tris_, settings_.mode, target, zbuffer, settings_.use_hiz ? &hiz_ : NULL, model_, pool_);
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    if (verbose_) {
+        std::cerr << "# raster " << elapsed << " ms, simd kernel " << simd_kernel_name() << std::endl;
+        if (settings_.use_hiz) hiz_.print_stats(std::cerr);
+    }
+    post_process(target);
+}
+
+// the passes over the finished colour and depth
+void RenderContext::post_process(TGAImage &target) {
+    if (!settings_.ssao) return;
+    ssao_.apply(zbuffer_.data(), target, pool_);
+    if (verbose_) ssao_.print_stats(std::cerr);
+}
+
+TGAImage &RenderContext::framebuffer() {
+    return image_;
+}
+
+const float *RenderContext::depth() const {
+    return zbuffer_.data();
+}
+
+const HiZBuffer &RenderContext::hiz() const {
+    return hiz_;
+}
+
+const ShadowMap &RenderContext::shadow_map() const {
+    return shadow_;
+}
+
+const GBuffer &RenderContext::gbuffer() const {
+    return gbuffer_;
+}
+
+const AmbientOcclusion &RenderContext::ambient_occlusion() const {
+    return ssao_;
+}
+
+const MsaaBuffer &RenderContext::msaa() const {
+    return msaa_;
+}
@@ -0,0 +1,105 @@
+#ifndef __RENDERER_H__
+#define __RENDERER_H__
+
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+#include "hiz.h"
+#include "tiler.h"
+#include "vertex.h"
+#include "cull.h"
+#include "shadow.h"
+#include "pipeline.h"
+#include "ssao.h"
+
+const int RENDER_DEPTH = 255; // depth range of the viewport transform
+
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up);
+Matrix viewport(int x, int y, int w, int h);
+// viewport(0, 0, factor*w, factor*h) shifted so that every factor x factor block of the large
+// image is centred on a pixel of the w x h one, for supersampling with downsample_box()
+Matrix supersampled_viewport(int w, int h, int factor);
+
+enum ShaderKind { SHADER_NONE, SHADER_FLAT, SHADER_GOURAUD, SHADER_TEXTURED, SHADER_PHONG, SHADER_MAPPED };
+
+// arguments of lookat() for one frame
+struct CameraPose {
+	Vec3f eye, center, up;
+};
+
+// how a RenderContext renders, the defaults are those of main
+struct RenderSettings {
+	int width, height;
+	int nthreads;        // 0 runs the plain serial face loop, N the binned rasterizer on N threads
+	RasterMode mode;
+	bool use_hiz;
+	CullWinding winding;
+	ShaderKind shader;   // SHADER_NONE is the fixed textured path
+	Vec3f light_dir;     // direction the light travels
+	int shadow_size;     // shadow map resolution for SHADER_PHONG and SHADER_MAPPED, 0 without shadows
+	bool deferred;       // the shaders run once per visible pixel after a G-buffer pass, see pipeline.h
+	bool ssao;           // screen-space ambient occlusion over the finished frame, see ssao.h
+	bool msaa;           // 4x multisampling, SHADER_NONE through TexturedShader (point-sampled), see msaa.h
+	RenderSettings();
+};
+
+// Reentrant renderer. A context owns its framebuffer, depth buffer, hierarchical z, tiler, thread
+// pool, shadow map, ambient occlusion, multisample and per-frame scratch buffers, nothing is
+// global, so independent contexts can render concurrently on different threads. The model is only
+// read: contexts may share one as long as it is not modified (texture filter included) while they
+// render.
+class RenderContext {
+private:
+	Model &model_;
+	RenderSettings settings_;
+	TGAImage image_;
+	std::vector<float> zbuffer_;
+	ThreadPool pool_;
+	HiZBuffer hiz_;
+	Tiler tiler_;
+	VertexProcessor vertices_;
+	PrimitiveCuller culler_;
+	std::vector<ScreenTriangle> tris_;
+	std::vector<ShadedTriangle> shaded_;
+	ShadowMap shadow_;
+	GBuffer gbuffer_;
+	AmbientOcclusion ssao_;
+	MsaaBuffer msaa_;
+	bool verbose_;
+	template <class Shader> void render_program(Shader &shader, TGAImage &target);
+	void post_process(TGAImage &target);
+	RenderContext(const RenderContext &);
+	RenderContext & operator =(const RenderContext &);
+public:
+	RenderContext(Model &model, const RenderSettings &settings=RenderSettings());
+	const RenderSettings &settings() const;
+	// new resolution, the buffers are reallocated
+	void resize(int width, int height);
+	// statistics of every stage to std::cerr
+	void set_verbose(bool verbose);
+	ThreadPool &pool();
+	// viewport*projection*modelview for a pose, the perspective is taken at the eye distance
+	mat4 camera_matrix(const CameraPose &pose) const;
+	// renders a pose into the framebuffer
+	void render(const CameraPose &pose);
+	// Any transform into target, which must have the size of the context. light and view are
+	// unit vectors towards the light and the viewer. The target, depth buffer and hiz are
+	// cleared first, so the same buffers serve frame after frame.
+	void render(const mat4 &MVP, Vec3f light, Vec3f view, TGAImage &target);
+	TGAImage &framebuffer();
+	const float *depth() const;
+	const HiZBuffer &hiz() const;
+	// rendered by the frames that use it, again only when the light direction changes
+	const ShadowMap &shadow_map() const;
+	// buffers and counts of the last deferred frame
+	const GBuffer &gbuffer() const;
+	// factors of the last frame with settings().ssao
+	const AmbientOcclusion &ambient_occlusion() const;
+	// samples of the last frame with settings().msaa, resolved into the target and the depth buffer
+	const MsaaBuffer &msaa() const;
+};
+
+#endif //__RENDERER_H__
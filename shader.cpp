@@ -0,0 +1,4 @@
+#include "shader.h"
+
+IShader::~IShader() {
+}
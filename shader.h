@@ -0,0 +1,236 @@
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include <cmath>
+#include <algorithm>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "model.h"
+#include "vertex.h"
+#include "rasterizer.h"
+#include "shadow.h"
+
+// Programmable stages. vertex() runs once per face corner: it returns the homogeneous screen
+// position (what VertexProcessor::clip holds) and writes layout().count() floats, which the
+// rasterizer interpolates as the layout says and hands to fragment(). fragment() returns false to discard the pixel; it is
+// called concurrently by the tiler's workers, hence const.
+// The shaders below are final: the pipeline templates (pipeline.h) instantiated with them inline
+// fragment() and know the varying count at compile time, instantiated with IShader they go
+// through the virtual calls.
+class IShader {
+public:
+	virtual ~IShader();
+	virtual VaryingLayout layout() const = 0;
+	virtual vec4 vertex(int iface, int nthvert, float *varyings) = 0;
+	virtual bool fragment(const float *varyings, TGAColor &color) const = 0;
+	// texels fetched per fragment() call, for the statistics only
+	virtual int texels() const { return 0; }
+};
+
+// what the built-in shaders read: the mesh, the transformed positions, a directional light and
+// optionally its shadow map (up to date for that light)
+struct ShaderContext {
+	Model &model;
+	const VertexProcessor &vertices;
+	Vec3f light; // unit vector towards the light, model space
+	Vec3f eye;   // unit vector towards the viewer, model space
+	const ShadowMap *shadow;
+	ShaderContext(Model &m, const VertexProcessor &v, Vec3f l, Vec3f e, const ShadowMap *s=NULL) : model(m), vertices(v), light(l), eye(e), shadow(s) {}
+	vec4 position(int iface, int nthvert) const {
+		return vertices.clip(model.vert(iface, nthvert));
+	}
+	// shadow map coordinates of a corner, transformed by the shadow pass
+	Vec3f shadow_position(int iface, int nthvert) const {
+		return shadow->position(model.vert(iface, nthvert));
+	}
+	Vec3f face_normal(int iface) const {
+		return model.face_normal(iface);
+	}
+	// the OBJ vertex normal, the face normal for corners without one
+	Vec3f normal(int iface, int nthvert) const {
+		return model.normal(iface, nthvert);
+	}
+	Vec2f uv(int iface, int nthvert) const {
+		return model.uv(iface, nthvert);
+	}
+};
+
+static inline TGAColor gray(float intensity) {
+	intensity = intensity>0 ? (intensity<1 ? intensity : 1) : 0; // NaN from degenerate faces too
+	unsigned char c = (unsigned char)(intensity*255);
+	return TGAColor(c, c, c, 255);
+}
+
+// one Lambert term per face, the lighting of the original commented out code
+class FlatShader final : public IShader {
+private:
+	ShaderContext ctx_;
+	float intensity_;
+public:
+	FlatShader(const ShaderContext &ctx) : ctx_(ctx), intensity_(0) {}
+	VaryingLayout layout() const override { return VaryingLayout{0, 0, 1}; }
+	// the same intensity on the three corners, computed with the first one
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		if (nthvert==0) intensity_ = ctx_.face_normal(iface)*ctx_.light;
+		varyings[0] = intensity_;
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		color = gray(varyings[0]);
+		return true;
+	}
+};
+
+// Lambert per vertex, interpolated
+class GouraudShader final : public IShader {
+private:
+	ShaderContext ctx_;
+public:
+	GouraudShader(const ShaderContext &ctx) : ctx_(ctx) {}
+	VaryingLayout layout() const override { return VaryingLayout{1, 0, 0}; }
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		varyings[0] = std::max(0.f, ctx_.normal(iface, nthvert)*ctx_.light);
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		color = gray(varyings[0]);
+		return true;
+	}
+};
+
+// unlit diffuse texture, the fixed textured path with perspective-correct uvs; point-sampled
+// like every shader here, the model's texture filter only applies to the fixed path
+class TexturedShader final : public IShader {
+private:
+	ShaderContext ctx_;
+public:
+	TexturedShader(const ShaderContext &ctx) : ctx_(ctx) {}
+	VaryingLayout layout() const override { return VaryingLayout{2, 0, 0}; }
+	int texels() const override { return 1; }
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		Vec2f uv = ctx_.uv(iface, nthvert);
+		varyings[0] = uv.x;
+		varyings[1] = uv.y;
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		color = ctx_.model.diffuse(Vec2f(varyings[0], varyings[1]));
+		return true;
+	}
+};
+
+// textured Blinn-Phong with per-pixel normals; with a shadow map in the context the light terms
+// are scaled by its PCF lookup, at the shadow map position interpolated as three more varyings
+class PhongShader final : public IShader {
+private:
+	ShaderContext ctx_;
+	Vec3f half_; // halfway between light and viewer
+public:
+	PhongShader(const ShaderContext &ctx) : ctx_(ctx), half_((ctx.light+ctx.eye).normalize()) {}
+	VaryingLayout layout() const override { return VaryingLayout{ctx_.shadow ? 8 : 5, 0, 0}; }
+	int texels() const override { return ctx_.shadow ? 1+(2*SHADOW_PCF_RADIUS+1)*(2*SHADOW_PCF_RADIUS+1) : 1; }
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		Vec2f uv = ctx_.uv(iface, nthvert);
+		Vec3f n = ctx_.normal(iface, nthvert);
+		varyings[0] = uv.x;
+		varyings[1] = uv.y;
+		varyings[2] = n.x;
+		varyings[3] = n.y;
+		varyings[4] = n.z;
+		if (ctx_.shadow) {
+			Vec3f s = ctx_.shadow_position(iface, nthvert);
+			varyings[5] = s.x;
+			varyings[6] = s.y;
+			varyings[7] = s.z;
+		}
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		Vec3f n = Vec3f(varyings[2], varyings[3], varyings[4]).normalize();
+		float lit = ctx_.shadow ? ctx_.shadow->lit(varyings[5], varyings[6], varyings[7]) : 1.f;
+		float diff = std::max(0.f, n*ctx_.light)*lit;
+		float spec = std::pow(std::max(0.f, n*half_), 32.f)*lit;
+		TGAColor c = ctx_.model.diffuse(Vec2f(varyings[0], varyings[1]));
+		for (int i=0; i<3; i++) {
+			c.raw[i] = (unsigned char)std::min(255.f, c.raw[i]*(.1f + .9f*diff) + 96.f*spec);
+		}
+		color = c;
+		return true;
+	}
+};
+
+// PhongShader through the model's surface maps (Model::surface()): the tangent- or object-space
+// normal map perturbs the normal, the specular map sets the exponent (5 + texel), and diffuse,
+// normal and specular come from a single interleaved texel fetch. Without maps (an empty
+// surface) it samples the diffuse texture and renders what PhongShader does. Cost budget: at most
+// 1.25x a PhongShader fragment (-bench shader).
+class MappedShader final : public IShader {
+private:
+	ShaderContext ctx_;
+	const SurfaceTexture &surface_;
+	Vec3f half_;
+	NormalMapSpace space_;
+	bool specular_;
+	bool maps_;
+public:
+	MappedShader(const ShaderContext &ctx) : ctx_(ctx), surface_(ctx.model.surface()), half_((ctx.light+ctx.eye).normalize()),
+		space_(ctx.model.normal_map_space()), specular_(ctx.model.has_specular_map()), maps_(!surface_.empty()) {}
+	VaryingLayout layout() const override { return VaryingLayout{ctx_.shadow ? 12 : 9, 0, 0}; }
+	int texels() const override { return ctx_.shadow ? 1+(2*SHADOW_PCF_RADIUS+1)*(2*SHADOW_PCF_RADIUS+1) : 1; }
+	vec4 vertex(int iface, int nthvert, float *varyings) override {
+		Vec2f uv = ctx_.uv(iface, nthvert);
+		Vec3f n = ctx_.normal(iface, nthvert);
+		varyings[0] = uv.x;
+		varyings[1] = uv.y;
+		varyings[2] = n.x;
+		varyings[3] = n.y;
+		varyings[4] = n.z;
+		if (maps_ && space_==NORMALS_TANGENT) {
+			vec4 t = ctx_.model.tangent(iface, nthvert);
+			for (int k=0; k<4; k++) varyings[5+k] = t[k];
+		} else {
+			for (int k=0; k<4; k++) varyings[5+k] = 0.f;
+		}
+		if (ctx_.shadow) {
+			Vec3f s = ctx_.shadow_position(iface, nthvert);
+			varyings[9]  = s.x;
+			varyings[10] = s.y;
+			varyings[11] = s.z;
+		}
+		return ctx_.position(iface, nthvert);
+	}
+	bool fragment(const float *varyings, TGAColor &color) const override {
+		Vec2f uv(varyings[0], varyings[1]);
+		Vec3f n = Vec3f(varyings[2], varyings[3], varyings[4]).normalize();
+		float exponent = 32.f;
+		TGAColor c;
+		if (maps_) {
+			const SurfaceTexel &s = surface_.fetch(uv);
+			if (space_!=NORMALS_NONE) {
+				Vec3f m(s.nx*(2.f/255.f)-1.f, s.ny*(2.f/255.f)-1.f, s.nz*(2.f/255.f)-1.f);
+				if (space_==NORMALS_TANGENT) {
+					// the interpolated tangent made orthogonal to the interpolated normal again
+					Vec3f t(varyings[5], varyings[6], varyings[7]);
+					t = t - n*(n*t);
+					Vec3f b = (n^t)*(varyings[8]<0 ? -1.f : 1.f);
+					m = t*m.x + b*m.y + n*m.z;
+				}
+				n = m.normalize();
+			}
+			if (specular_) exponent = 5.f+s.spec;
+			c = TGAColor((int)s.diffuse, TGAImage::RGB);
+		} else {
+			c = ctx_.model.diffuse(uv);
+		}
+		float lit = ctx_.shadow ? ctx_.shadow->lit(varyings[9], varyings[10], varyings[11]) : 1.f;
+		float diff = std::max(0.f, n*ctx_.light)*lit;
+		float spec = std::pow(std::max(0.f, n*half_), exponent)*lit;
+		for (int i=0; i<3; i++) {
+			c.raw[i] = (unsigned char)std::min(255.f, c.raw[i]*(.1f + .9f*diff) + 96.f*spec);
+		}
+		color = c;
+		return true;
+	}
+};
+
+#endif //__SHADER_H__
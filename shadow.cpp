@@ -0,0 +1,109 @@
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include "shadow.h"
+#include "renderer.h"
+#include "profile.h"
+
+ShadowMap::ShadowMap(int size) : size_(size), depth_(size*size), vertices_(), culler_(size, size), tiler_(size, size),
+    tris_(), model_(NULL), light_dir_(0, 0, 0), bias_(0), written_(0), ms_(0) {
+    culler_.set_winding(CULL_NONE);
+    // one texel of a surface at 60 degrees to the light, for every texel of the PCF radius
+    bias_ = 1.75f*RENDER_DEPTH/size*(SHADOW_PCF_RADIUS+1);
+}
+
+int ShadowMap::size() const {
+    return size_;
+}
+
+void ShadowMap::invalidate() {
+    model_ = NULL;
+}
+
+bool ShadowMap::update(Model &model, Vec3f light_dir, ThreadPool &pool) {
+    light_dir = light_dir.normalize();
+    if (model_==&model && light_dir.x==light_dir_.x && light_dir.y==light_dir_.y && light_dir.z==light_dir_.z) return false;
+    PROFILE_SCOPE("shadow pass");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // orthographic view from the light, the bounding sphere around the origin fills the map
+    int n = model.nverts();
+    const float *x = model.vert_component(0), *y = model.vert_component(1), *z = model.vert_component(2);
+    float r2 = 0;
+    for (int i=0; i<n; i++) r2 = std::max(r2, x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    float r = r2>0 ? std::sqrt(r2) : 1.f;
+    Vec3f up = std::abs(light_dir.y)>.99f ? Vec3f(0, 0, 1) : Vec3f(0, 1, 0);
+    Matrix scale = Matrix::identity(4);
+    for (int i=0; i<3; i++) scale[i][i] = 1.f/r;
+    transform_ = mat4(viewport(0, 0, size_, size_))*mat4(scale)*mat4(lookat(light_dir*-1.f, Vec3f(0, 0, 0), up));
+    vertices_.transform(model, transform_, pool);
+
+    // positions only; the fitted projection leaves nothing to clip but degenerate corners
+    {
+        PROFILE_SCOPE("primitive assembly");
+        int nfaces = model.nfaces();
+        const int *vidx = model.facet_verts();
+        culler_.reset_stats();
+        tris_.clear();
+        tris_.reserve(nfaces);
+        ClipVertex poly[MAX_CLIP_VERTS];
+        const float *none[3] = {NULL, NULL, NULL};
+        for (int i=0; i<nfaces; i++) {
+            vec4 h[3];
+            for (int j=0; j<3; j++) h[j] = vertices_.clip(vidx[i*3+j]);
+            CullResult res = culler_.classify(h);
+            if (res==PRIM_CULLED) continue;
+            DepthTriangle t;
+            if (res==PRIM_INSIDE) {
+                for (int j=0; j<3; j++) t.pts[j] = vertices_.screen(vidx[i*3+j]);
+                tris_.push_back(t);
+                continue;
+            }
+            int m = culler_.clip(h, none, 0, poly);
+            for (int k=1; k+1<m; k++) {
+                const ClipVertex *c[3] = {&poly[0], &poly[k], &poly[k+1]};
+                for (int j=0; j<3; j++) t.pts[j] = Vec3f(c[j]->h[0]/c[j]->h[3], c[j]->h[1]/c[j]->h[3], c[j]->h[2]/c[j]->h[3]);
+                tris_.push_back(t);
+            }
+        }
+        culler_.count_out(tris_.size());
+        vertices_.count_references(3*(long)nfaces);
+    }
+
+    // the nearest depth is kept whatever the order, so the tiles need no ordering between them
+    std::fill(depth_.begin(), depth_.end(), -std::numeric_limits<float>::max());
+    tiler_.bin(tris_);
+    std::atomic<long> written(0);
+    pool.parallel_for(tiler_.ntiles(), [&](int tile) {
+        if (!tiler_.bin_size(tile)) return;
+        PROFILE_SCOPE("shadow tile");
+        Vec2i clipmin, clipmax;
+        tiler_.tile_rect(tile, clipmin, clipmax);
+        const int *bin = tiler_.bin_triangles(tile);
+        long w = 0;
+        for (int i=0; i<tiler_.bin_size(tile); i++) {
+            w += triangle_depth(tris_[bin[i]].pts, depth_.data(), size_, clipmin, clipmax);
+        }
+        written += w;
+    });
+    written_ = written;
+    model_ = &model;
+    light_dir_ = light_dir;
+    ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    return true;
+}
+
+const mat4 &ShadowMap::transform() const {
+    return transform_;
+}
+
+const float *ShadowMap::depth() const {
+    return depth_.data();
+}
+
+void ShadowMap::print_stats(std::ostream &s) const {
+    s << "# shadow map " << size_ << "x" << size_ << ", " << tris_.size() << " triangles, " << written_
+      << " depth writes, rendered in " << ms_ << " ms" << std::endl;
+}
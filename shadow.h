@@ -0,0 +1,76 @@
+#ifndef __SHADOW_H__
+#define __SHADOW_H__
+
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "vertex.h"
+#include "cull.h"
+#include "tiler.h"
+#include "threadpool.h"
+
+const int SHADOW_PCF_RADIUS = 1; // (2r+1)^2 taps per lookup
+
+// Shadow map of a directional light: the depth of the model seen from the light, rendered
+// through lookat()/viewport() with an orthographic projection fitted around the model's bounding
+// sphere. The pass is depth-only (triangle_depth): no varyings, texture or colour writes, both
+// windings, binned over the pool. The light-space position of every vertex stays in the map's
+// VertexProcessor, so the main pass reads it instead of transforming each corner again, and
+// update() renders only when the model or the light direction changed since the last call.
+class ShadowMap {
+private:
+	int size_;
+	std::vector<float> depth_;
+	VertexProcessor vertices_;
+	PrimitiveCuller culler_;
+	Tiler tiler_;
+	std::vector<DepthTriangle> tris_;
+	mat4 transform_;
+	const Model *model_; // rendered for, NULL when out of date
+	Vec3f light_dir_;
+	float bias_;
+	long written_;
+	double ms_;
+public:
+	ShadowMap(int size);
+	int size() const;
+	// renders the map unless it is up to date, light_dir is the direction the light travels;
+	// true when it was rendered
+	bool update(Model &model, Vec3f light_dir, ThreadPool &pool);
+	// the next update() renders again, for a model whose vertices were modified
+	void invalidate();
+	// model space to shadow map pixels and depth
+	const mat4 &transform() const;
+	// shadow map coordinates of model vertex i, valid after update()
+	const Vec3f &position(int i) const {
+		return vertices_.screen(i);
+	}
+	// percentage closer filtering: the fraction of the taps around (x, y) that do not occlude depth z
+	float lit(float x, float y, float z) const {
+		const int r = SHADOW_PCF_RADIUS;
+		int cx = int(std::floor(x+.5f)), cy = int(std::floor(y+.5f));
+		float ref = z+bias_;
+		int lit = 0;
+		if (cx>=r && cy>=r && cx<size_-r && cy<size_-r) {
+			const float *p = depth_.data()+(cy-r)*size_+cx-r;
+			for (int j=0; j<=2*r; j++, p+=size_) {
+				for (int i=0; i<=2*r; i++) lit += ref>=p[i];
+			}
+		} else { // taps beyond the border repeat the edge texels
+			for (int j=-r; j<=r; j++) {
+				const float *row = depth_.data()+std::min(size_-1, std::max(0, cy+j))*size_;
+				for (int i=-r; i<=r; i++) lit += ref>=row[std::min(size_-1, std::max(0, cx+i))];
+			}
+		}
+		return lit*(1.f/((2*r+1)*(2*r+1)));
+	}
+	const float *depth() const;
+	// size, triangles, depth values written and time of the last render
+	void print_stats(std::ostream &s) const;
+};
+
+#endif //__SHADOW_H__
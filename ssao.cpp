@@ -0,0 +1,283 @@
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include "ssao.h"
+#include "renderer.h"
+#include "profile.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SSAO_X86 1
+#endif
+
+static const int SSAO_BAND = 16;      // rows per task of the pool, both resolutions
+static const float SSAO_BIAS = .25f;  // rise per pair spread ignored, the facets of the mesh
+
+AmbientOcclusion::AmbientOcclusion(int width, int height, float radius, float strength) : width_(0), height_(0),
+	hw_(0), hh_(0), pad_(0), stride_(0), depth_(), raw_(), ao_(), radius_(radius), strength_(strength), occluded_(0), ms_(0) {
+	// half resolution radius; the pairs cover half a circle, each row of four turned by a quarter step
+	float r = std::max(1.f, radius*.5f);
+	for (int j=0; j<4; j++) {
+		for (int k=0; k<SSAO_PAIRS; k++) {
+			float angle = float(M_PI)*(k + j*.25f)/SSAO_PAIRS;
+			float len = r*((k*3+j)%SSAO_PAIRS + 1.f)/SSAO_PAIRS;
+			int ox = int(std::floor(std::cos(angle)*len+.5f)), oy = int(std::floor(std::sin(angle)*len+.5f));
+			if (!ox && !oy) ox = 1;
+			dx_[j][k] = ox;
+			dy_[j][k] = oy;
+			spread_[j][k] = .5f/std::sqrt(float(ox*ox + oy*oy));
+		}
+	}
+	resize(width, height);
+}
+
+void AmbientOcclusion::resize(int width, int height) {
+	width_  = width;
+	height_ = height;
+	hw_ = (width+1)/2;
+	hh_ = (height+1)/2;
+	pad_ = int(std::ceil(radius_*.5f)) + 4; // the offsets plus the lanes past the end of a row
+	stride_ = hw_ + 2*pad_;
+	depth_.assign(size_t(stride_)*(hh_+2*pad_), -std::numeric_limits<float>::max());
+	raw_.assign(size_t(stride_)*hh_, 1.f);
+	ao_.assign(size_t(stride_)*hh_, 1.f);
+	for (int j=0; j<4; j++) {
+		for (int k=0; k<SSAO_PAIRS; k++) offsets_[j][k] = dy_[j][k]*stride_ + dx_[j][k];
+	}
+}
+
+// half resolution rows [y0, y1) of raw_ from depth_
+void AmbientOcclusion::occlude_rows(int y0, int y1) {
+	const float scale = width_/(2.f*RENDER_DEPTH); // depth to half resolution pixels
+	const float range = radius_*.5f;
+	const float background = -std::numeric_limits<float>::max();
+	const float weight = strength_/SSAO_PAIRS;
+	for (int y=y0; y<y1; y++) {
+		const float *row = depth_.data() + size_t(y+pad_)*stride_ + pad_;
+		float *out = raw_.data() + size_t(y)*stride_ + pad_;
+		const int *off = offsets_[y&3];
+		const float *spread = spread_[y&3];
+		int x = 0;
+#ifdef SSAO_X86
+		const __m128 vscale = _mm_set1_ps(scale), vrange = _mm_set1_ps(range), vbias = _mm_set1_ps(SSAO_BIAS);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), vweight = _mm_set1_ps(weight);
+		const __m128 vbackground = _mm_set1_ps(background);
+		const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		for (; x<hw_; x+=4) { // the last lanes read the border and write the stride
+			__m128 d = _mm_loadu_ps(row+x);
+			__m128 covered = _mm_cmpgt_ps(d, vbackground);
+			if (!_mm_movemask_ps(covered)) {
+				_mm_storeu_ps(out+x, one);
+				continue;
+			}
+			__m128 occ = zero;
+			for (int k=0; k<SSAO_PAIRS; k++) {
+				__m128 h1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row+x+off[k]), d), vscale);
+				__m128 h2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row+x-off[k]), d), vscale);
+				__m128 valid = _mm_and_ps(_mm_cmplt_ps(_mm_and_ps(h1, absmask), vrange), _mm_cmplt_ps(_mm_and_ps(h2, absmask), vrange));
+				__m128 o = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(h1, h2), _mm_set1_ps(spread[k])), vbias);
+				o = _mm_min_ps(_mm_max_ps(o, zero), one);
+				occ = _mm_add_ps(occ, _mm_and_ps(valid, o));
+			}
+			__m128 ao = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(occ, vweight)), zero);
+			_mm_storeu_ps(out+x, _mm_or_ps(_mm_and_ps(covered, ao), _mm_andnot_ps(covered, one)));
+		}
+#endif
+		for (; x<hw_; x++) {
+			float d = row[x];
+			if (d==background) {
+				out[x] = 1.f;
+				continue;
+			}
+			float occ = 0;
+			for (int k=0; k<SSAO_PAIRS; k++) {
+				float h1 = (row[x+off[k]]-d)*scale, h2 = (row[x-off[k]]-d)*scale;
+				if (std::abs(h1)<range && std::abs(h2)<range) occ += std::min(1.f, std::max(0.f, (h1+h2)*spread[k]-SSAO_BIAS));
+			}
+			out[x] = std::max(0.f, 1.f-occ*weight);
+		}
+	}
+}
+
+// half resolution rows [y0, y1) of ao_ from raw_, rows y-2..y+2 weighted 1 2 2 2 1 over one plus
+// the depth difference in pixels
+void AmbientOcclusion::blur_rows(int y0, int y1) {
+	const float scale = width_/(2.f*RENDER_DEPTH);
+	const float taps[5] = {1.f, 2.f, 2.f, 2.f, 1.f};
+	for (int y=y0; y<y1; y++) {
+		const float *d[5], *a[5];
+		for (int t=0; t<5; t++) {
+			int j = std::min(std::max(y+t-2, 0), hh_-1);
+			d[t] = depth_.data() + size_t(j+pad_)*stride_ + pad_;
+			a[t] = raw_.data() + size_t(j)*stride_ + pad_;
+		}
+		float *out = ao_.data() + size_t(y)*stride_ + pad_;
+		int x = 0;
+#ifdef SSAO_X86
+		const __m128 vscale = _mm_set1_ps(scale), one = _mm_set1_ps(1.f);
+		const __m128 vbackground = _mm_set1_ps(-std::numeric_limits<float>::max());
+		const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		for (; x<hw_; x+=4) {
+			__m128 z = _mm_loadu_ps(d[2]+x);
+			if (!_mm_movemask_ps(_mm_cmpgt_ps(z, vbackground))) {
+				_mm_storeu_ps(out+x, one);
+				continue;
+			}
+			__m128 sum = _mm_setzero_ps(), wsum = _mm_setzero_ps();
+			for (int t=0; t<5; t++) {
+				__m128 dz = _mm_mul_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(d[t]+x), z), absmask), vscale);
+				__m128 w = _mm_div_ps(_mm_set1_ps(taps[t]), _mm_add_ps(one, dz));
+				sum = _mm_add_ps(sum, _mm_mul_ps(w, _mm_loadu_ps(a[t]+x)));
+				wsum = _mm_add_ps(wsum, w);
+			}
+			// the centre tap keeps wsum>=2 on covered pixels; background lanes are 1 anyway
+			_mm_storeu_ps(out+x, _mm_div_ps(sum, wsum));
+		}
+#endif
+		for (; x<hw_; x++) {
+			float z = d[2][x], sum = 0, wsum = 0;
+			for (int t=0; t<5; t++) {
+				float w = taps[t]/(1.f + std::abs(d[t][x]-z)*scale);
+				sum += w*a[t][x];
+				wsum += w;
+			}
+			out[x] = sum/wsum;
+		}
+	}
+}
+
+// full resolution rows [y0, y1) of image: the four nearest factors, bilinear weights over one plus
+// the depth difference in pixels. Four pixels from an even x take their neighbours from the half
+// resolution columns x/2-1 .. x/2+2, beyond the image the border weighs nothing.
+void AmbientOcclusion::upsample_rows(const float *zbuffer, TGAImage &image, int y0, int y1, long &occluded) const {
+	const float scale = float(width_)/RENDER_DEPTH; // depth to full resolution pixels
+	const float background = -std::numeric_limits<float>::max();
+	const float opaque = 1.f-.5f/255;
+	int bpp = image.get_bytespp(), nc = std::min(bpp, 3);
+	unsigned char *pixels = image.buffer();
+	long n = 0;
+	for (int y=y0; y<y1; y++) {
+		int j0 = (y-1)>>1, ja = std::max(j0, 0), jb = std::min(j0+1, hh_-1);
+		float ty = y&1 ? .25f : .75f; // the weight of row j0+1
+		const float *da = depth_.data() + size_t(ja+pad_)*stride_ + pad_, *db = depth_.data() + size_t(jb+pad_)*stride_ + pad_;
+		const float *aa = ao_.data() + size_t(ja)*stride_ + pad_, *ab = ao_.data() + size_t(jb)*stride_ + pad_;
+		const float *zrow = zbuffer + size_t(y)*width_;
+		unsigned char *row = pixels + size_t(y)*width_*bpp;
+		int x = 0;
+#ifdef SSAO_X86
+		const __m128 vscale = _mm_set1_ps(scale), one = _mm_set1_ps(1.f), vbackground = _mm_set1_ps(background);
+		const __m128 vopaque = _mm_set1_ps(opaque);
+		const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		// even lanes lean to the right neighbour, odd lanes to the left one
+		const __m128 wl = _mm_set_ps(.75f, .25f, .75f, .25f), wr = _mm_set_ps(.25f, .75f, .25f, .75f);
+		const __m128 wa = _mm_set1_ps(1.f-ty), wb = _mm_set1_ps(ty);
+		float ao[4];
+		for (; x+4<=width_; x+=4) {
+			__m128 z = _mm_loadu_ps(zrow+x);
+			__m128 covered = _mm_cmpgt_ps(z, vbackground);
+			if (!_mm_movemask_ps(covered)) continue;
+			int i = x>>1;
+			// nothing to darken where all the neighbours are unoccluded, most of the covered pixels
+			__m128 amin = _mm_min_ps(_mm_loadu_ps(aa+i-1), _mm_loadu_ps(ab+i-1));
+			if (!_mm_movemask_ps(_mm_cmplt_ps(amin, vopaque))) continue;
+			__m128 num = _mm_setzero_ps(), den = _mm_setzero_ps();
+			const float *drow[2] = {da, db}, *arow[2] = {aa, ab};
+			__m128 wrow[2] = {wa, wb};
+			for (int r=0; r<2; r++) {
+				__m128 d = _mm_loadu_ps(drow[r]+i-1), a = _mm_loadu_ps(arow[r]+i-1);
+				__m128 dl = _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 1, 1, 0)), dr = _mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 2, 2, 1));
+				__m128 al = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 1, 1, 0)), ar = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 2, 2, 1));
+				__m128 el = _mm_add_ps(one, _mm_mul_ps(_mm_and_ps(_mm_sub_ps(dl, z), absmask), vscale));
+				__m128 er = _mm_add_ps(one, _mm_mul_ps(_mm_and_ps(_mm_sub_ps(dr, z), absmask), vscale));
+				__m128 w0 = _mm_mul_ps(_mm_mul_ps(wl, wrow[r]), _mm_rcp_ps(el));
+				__m128 w1 = _mm_mul_ps(_mm_mul_ps(wr, wrow[r]), _mm_rcp_ps(er));
+				num = _mm_add_ps(num, _mm_add_ps(_mm_mul_ps(w0, al), _mm_mul_ps(w1, ar)));
+				den = _mm_add_ps(den, _mm_add_ps(w0, w1));
+			}
+			// den is 0 only next to the background on every side, the pixel keeps its colour then
+			__m128 valid = _mm_and_ps(covered, _mm_cmpgt_ps(den, _mm_setzero_ps()));
+			__m128 v = _mm_div_ps(num, _mm_or_ps(den, _mm_andnot_ps(valid, one)));
+			int bits = _mm_movemask_ps(_mm_and_ps(valid, _mm_cmplt_ps(v, vopaque)));
+			if (!bits) continue;
+			_mm_storeu_ps(ao, v);
+			for (int k=0; k<4; k++) {
+				if (!(bits>>k&1)) continue;
+				unsigned char *p = row + (x+k)*bpp;
+				for (int c=0; c<nc; c++) p[c] = (unsigned char)(p[c]*ao[k] + .5f);
+				n++;
+			}
+		}
+#endif
+		for (; x<width_; x++) {
+			float z = zrow[x];
+			if (z==background) continue;
+			int i0 = (x-1)>>1, ia = std::max(i0, 0), ib = std::min(i0+1, hw_-1);
+			float tx = x&1 ? .25f : .75f;
+			float w00 = (1-tx)*(1-ty)/(1.f + std::abs(da[ia]-z)*scale);
+			float w10 = tx*(1-ty)/(1.f + std::abs(da[ib]-z)*scale);
+			float w01 = (1-tx)*ty/(1.f + std::abs(db[ia]-z)*scale);
+			float w11 = tx*ty/(1.f + std::abs(db[ib]-z)*scale);
+			float sum = w00+w10+w01+w11;
+			if (!(sum>0)) continue;
+			float ao = (w00*aa[ia] + w10*aa[ib] + w01*ab[ia] + w11*ab[ib])/sum;
+			if (ao>=opaque) continue;
+			unsigned char *p = row + x*bpp;
+			for (int c=0; c<nc; c++) p[c] = (unsigned char)(p[c]*ao + .5f);
+			n++;
+		}
+	}
+	occluded = n;
+}
+
+void AmbientOcclusion::apply(const float *zbuffer, TGAImage &image, ThreadPool &pool) {
+	PROFILE_SCOPE("ssao");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (image.get_width()!=width_ || image.get_height()!=height_) resize(image.get_width(), image.get_height());
+
+	// the nearest depth of each 2x2 block, a silhouette stays on its foreground side
+	int nbands = (hh_+SSAO_BAND-1)/SSAO_BAND;
+	pool.parallel_for(nbands, [&](int band) {
+		PROFILE_SCOPE("ssao downsample");
+		for (int y=band*SSAO_BAND; y<std::min(hh_, (band+1)*SSAO_BAND); y++) {
+			const float *r0 = zbuffer + size_t(2*y)*width_, *r1 = zbuffer + size_t(std::min(2*y+1, height_-1))*width_;
+			float *out = depth_.data() + size_t(y+pad_)*stride_ + pad_;
+			for (int x=0; x<hw_; x++) {
+				int x0 = 2*x, x1 = std::min(2*x+1, width_-1);
+				out[x] = std::max(std::max(r0[x0], r0[x1]), std::max(r1[x0], r1[x1]));
+			}
+		}
+	});
+	pool.parallel_for(nbands, [&](int band) {
+		PROFILE_SCOPE("ssao occlusion");
+		occlude_rows(band*SSAO_BAND, std::min(hh_, (band+1)*SSAO_BAND));
+	});
+	pool.parallel_for(nbands, [&](int band) {
+		PROFILE_SCOPE("ssao blur");
+		blur_rows(band*SSAO_BAND, std::min(hh_, (band+1)*SSAO_BAND));
+	});
+	std::atomic<long> occluded(0);
+	nbands = (height_+SSAO_BAND-1)/SSAO_BAND;
+	pool.parallel_for(nbands, [&](int band) {
+		PROFILE_SCOPE("ssao upsample");
+		long n = 0;
+		upsample_rows(zbuffer, image, band*SSAO_BAND, std::min(height_, (band+1)*SSAO_BAND), n);
+		occluded += n;
+	});
+	occluded_ = occluded;
+	ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+const float *AmbientOcclusion::occlusion() const {
+	return ao_.data() + pad_;
+}
+
+int AmbientOcclusion::stride() const {
+	return stride_;
+}
+
+void AmbientOcclusion::print_stats(std::ostream &s) const {
+	s << "# ssao " << hw_ << "x" << hh_ << ", " << SSAO_PAIRS << " sample pairs, " << occluded_
+	  << " pixels darkened in " << ms_ << " ms" << std::endl;
+}
@@ -0,0 +1,53 @@
+#ifndef __SSAO_H__
+#define __SSAO_H__
+
+#include <vector>
+#include <iostream>
+#include "tgaimage.h"
+#include "threadpool.h"
+
+const int SSAO_PAIRS = 8; // pairs of opposite samples per half resolution pixel
+
+// Screen-space ambient occlusion, a post-pass over the depth buffer of a finished frame. The depth
+// is reduced to half resolution (the nearest of every 2x2 block). Each half resolution pixel then
+// looks at pairs of opposite samples within the radius. Over a plane the two depth differences
+// cancel out; in a crease both rise above the pixel, so a pair occludes by how far the sum of its
+// rises exceeds the pair's spread. A pair with a sample out of range (a foreground silhouette or
+// the background) is left out. The sample pattern turns from row to row
+// over four rows, which a vertical [1 2 2 2 1] blur (weighted by depth like the upsample) evens
+// out. The factors are then upsampled bilaterally (bilinear weights damped by the depth
+// difference, so no occlusion bleeds over silhouettes) and multiply the colour. Every stage runs
+// in bands of rows on the pool, four pixels per SSE register.
+class AmbientOcclusion {
+private:
+	int width_, height_;         // full resolution
+	int hw_, hh_;                // half resolution
+	int pad_, stride_;           // background border of the half resolution depth, its row length
+	std::vector<float> depth_;   // half resolution depth with the border
+	std::vector<float> raw_;     // half resolution factors before the blur, stride_ per row
+	std::vector<float> ao_;      // after it, 1 unoccluded
+	float radius_, strength_;
+	int dx_[4][SSAO_PAIRS], dy_[4][SSAO_PAIRS]; // per row (y&3), half resolution sample offsets
+	int offsets_[4][SSAO_PAIRS]; // the same as indices into the padded depth
+	float spread_[4][SSAO_PAIRS]; // 1/(2*length) of the offsets
+	long occluded_;
+	double ms_;
+	void occlude_rows(int y0, int y1);
+	void blur_rows(int y0, int y1);
+	void upsample_rows(const float *zbuffer, TGAImage &image, int y0, int y1, long &occluded) const;
+public:
+	// radius in full resolution pixels; strength/SSAO_PAIRS of the summed pair occlusion is taken off
+	// the colour, a pair seeing a right-angle crease occludes by about .75
+	AmbientOcclusion(int width, int height, float radius=48.f, float strength=3.f);
+	void resize(int width, int height);
+	// darkens image by the occlusion of zbuffer: the frame's depth, width*height values, -FLT_MAX
+	// for the background, larger values nearer to the viewer
+	void apply(const float *zbuffer, TGAImage &image, ThreadPool &pool);
+	// half resolution factors of the last apply, row i at occlusion()+i*stride()
+	const float *occlusion() const;
+	int stride() const;
+	// resolution, pixels darkened and time of the last apply
+	void print_stats(std::ostream &s) const;
+};
+
+#endif //__SSAO_H__
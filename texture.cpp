@@ -0,0 +1,218 @@
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include "texture.h"
+
+Texture::Texture() : texels_(), levels_() {
+}
+
+inline uint32_t Texture::texel(const Level &l, int x, int y) const {
+	x = std::min(std::max(x, 0), l.width-1);
+	y = std::min(std::max(y, 0), l.height-1);
+	size_t block = size_t(y>>2)*l.bw + (x>>2);
+	return texels_[l.offset + block*16 + ((y&3)<<2) + (x&3)];
+}
+
+void Texture::build(TGAImage &img) {
+	texels_.clear();
+	levels_.clear();
+	int w = img.get_width(), h = img.get_height(), bpp = img.get_bytespp();
+	const unsigned char *src = img.buffer();
+	if (!src || w<=0 || h<=0 || (bpp!=TGAImage::GRAYSCALE && bpp!=TGAImage::RGB && bpp!=TGAImage::RGBA)) return;
+
+	size_t total = 0;
+	for (int lw=w, lh=h; ; lw=std::max(1, lw/2), lh=std::max(1, lh/2)) {
+		Level l;
+		l.width  = lw;
+		l.height = lh;
+		l.bw     = (lw+TEXTURE_BLOCK-1)/TEXTURE_BLOCK;
+		l.offset = total;
+		total += size_t(l.bw)*((lh+TEXTURE_BLOCK-1)/TEXTURE_BLOCK)*TEXTURE_BLOCK*TEXTURE_BLOCK;
+		levels_.push_back(l);
+		if (lw==1 && lh==1) break;
+	}
+	texels_.assign(total, 0);
+
+	// level 0 in linear order first, then swizzled; the block padding repeats the edge texels
+	std::vector<uint32_t> linear(size_t(w)*h), next;
+	for (int i=0; i<w*h; i++) {
+		const unsigned char *p = src+size_t(i)*bpp;
+		uint32_t c;
+		if (bpp==TGAImage::GRAYSCALE) c = p[0] | p[0]<<8 | p[0]<<16 | 0xff000000u;
+		else c = p[0] | p[1]<<8 | p[2]<<16 | (bpp==TGAImage::RGBA ? uint32_t(p[3])<<24 : 0xff000000u);
+		linear[i] = c;
+	}
+	for (int k=0; k<(int)levels_.size(); k++) {
+		const Level &l = levels_[k];
+		int bh = (l.height+TEXTURE_BLOCK-1)/TEXTURE_BLOCK;
+		uint32_t *dst = texels_.data()+l.offset;
+		for (int y=0; y<bh*TEXTURE_BLOCK; y++) {
+			const uint32_t *row = linear.data()+size_t(std::min(y, l.height-1))*l.width;
+			for (int x=0; x<l.bw*TEXTURE_BLOCK; x++) {
+				dst[(size_t(y>>2)*l.bw + (x>>2))*16 + ((y&3)<<2) + (x&3)] = row[std::min(x, l.width-1)];
+			}
+		}
+		if (k+1==(int)levels_.size()) break;
+		// 2x2 box filter, odd sizes reuse the last row/column
+		const Level &n = levels_[k+1];
+		next.assign(size_t(n.width)*n.height, 0);
+		for (int y=0; y<n.height; y++) {
+			const uint32_t *r0 = linear.data()+size_t(std::min(2*y,   l.height-1))*l.width;
+			const uint32_t *r1 = linear.data()+size_t(std::min(2*y+1, l.height-1))*l.width;
+			for (int x=0; x<n.width; x++) {
+				int x0 = std::min(2*x, l.width-1), x1 = std::min(2*x+1, l.width-1);
+				uint32_t c = 0;
+				for (int s=0; s<32; s+=8) {
+					uint32_t sum = (r0[x0]>>s & 0xff) + (r0[x1]>>s & 0xff) + (r1[x0]>>s & 0xff) + (r1[x1]>>s & 0xff);
+					c |= ((sum+2)>>2) << s;
+				}
+				next[size_t(x)+size_t(y)*n.width] = c;
+			}
+		}
+		linear.swap(next);
+	}
+}
+
+bool Texture::empty() const {
+	return levels_.empty();
+}
+
+int Texture::nlevels() const {
+	return (int)levels_.size();
+}
+
+int Texture::width(int level) const {
+	return levels_[level].width;
+}
+
+int Texture::height(int level) const {
+	return levels_[level].height;
+}
+
+size_t Texture::bytes() const {
+	return texels_.size()*sizeof(uint32_t);
+}
+
+uint32_t Texture::fetch(int level, int x, int y) const {
+	return texel(levels_[level], x, y);
+}
+
+float Texture::lod(float dudx, float dvdx, float dudy, float dvdy) const {
+	if (levels_.empty()) return 0;
+	float w = levels_[0].width, h = levels_[0].height;
+	float lx = dudx*dudx*w*w + dvdx*dvdx*h*h;
+	float ly = dudy*dudy*w*w + dvdy*dvdy*h*h;
+	float l = std::max(lx, ly);
+	return l>0 ? .5f*std::log2(l) : 0.f;
+}
+
+// blends two packed texels, two channels per multiply; f in [0, 256]
+static inline uint32_t lerp_texel(uint32_t a, uint32_t b, uint32_t f) {
+	uint32_t g = 256-f;
+	uint32_t rb = (((a&0x00ff00ffu)*g + (b&0x00ff00ffu)*f) >> 8) & 0x00ff00ffu;
+	uint32_t ag = (((a>>8)&0x00ff00ffu)*g + ((b>>8)&0x00ff00ffu)*f) & 0xff00ff00u;
+	return rb | ag;
+}
+
+uint32_t Texture::bilinear(int level, float u, float v) const {
+	const Level &l = levels_[level];
+	float x = u*l.width-.5f, y = v*l.height-.5f;
+	float fx = std::floor(x), fy = std::floor(y);
+	int x0 = int(fx), y0 = int(fy);
+	uint32_t wx = uint32_t((x-fx)*256.f+.5f), wy = uint32_t((y-fy)*256.f+.5f);
+	uint32_t top = lerp_texel(texel(l, x0, y0),   texel(l, x0+1, y0),   wx);
+	uint32_t bot = lerp_texel(texel(l, x0, y0+1), texel(l, x0+1, y0+1), wx);
+	return lerp_texel(top, bot, wy);
+}
+
+uint32_t Texture::sample(float u, float v, float lod, TextureFilter filter) const {
+	if (levels_.empty()) return 0;
+	int last = (int)levels_.size()-1;
+	// clamping uv up front is the same as clamping texel coordinates, and NaNs end up at 0
+	u = u>0 ? (u<1 ? u : 1) : 0;
+	v = v>0 ? (v<1 ? v : 1) : 0;
+	lod = lod>0 ? (lod<last ? lod : last) : 0;
+	if (filter==FILTER_TRILINEAR) {
+		int l0 = int(lod);
+		uint32_t f = uint32_t((lod-l0)*256.f+.5f);
+		uint32_t a = bilinear(l0, u, v);
+		if (l0==last || f==0) return a;
+		return lerp_texel(a, bilinear(l0+1, u, v), f);
+	}
+	int level = int(lod+.5f);
+	if (filter==FILTER_BILINEAR) return bilinear(level, u, v);
+	const Level &l = levels_[level];
+	return texel(l, int(std::floor(u*l.width)), int(std::floor(v*l.height)));
+}
+
+const SurfaceTexel SurfaceTexture::outside_ = {0, 128, 128, 255, 0};
+
+SurfaceTexture::SurfaceTexture() : width_(0), height_(0), texels_() {
+}
+
+static bool present(TGAImage &img) {
+	return img.buffer() && img.get_width()>0 && img.get_height()>0;
+}
+
+// byte offsets of the texels of img nearest to the columns of a width wide grid
+static std::vector<size_t> nearest_columns(TGAImage &img, int width) {
+	std::vector<size_t> cols(width);
+	for (int x=0; x<width; x++) cols[x] = size_t((long long)x*img.get_width()/width)*img.get_bytespp();
+	return cols;
+}
+
+// the row of img nearest to row y of a height high grid
+static const unsigned char *nearest_row(TGAImage &img, int y, int height) {
+	int sy = int((long long)y*img.get_height()/height);
+	return img.buffer()+size_t(sy)*img.get_width()*img.get_bytespp();
+}
+
+void SurfaceTexture::build(TGAImage &diffuse, TGAImage &normal, TGAImage &specular) {
+	TGAImage *maps[3] = {&diffuse, &normal, &specular};
+	width_ = height_ = 0;
+	for (TGAImage *m : maps) { // the first map present sets the resolution
+		if (present(*m)) {
+			width_  = m->get_width();
+			height_ = m->get_height();
+			break;
+		}
+	}
+	texels_.assign(size_t(width_)*height_, outside_);
+	bool has_diffuse = present(diffuse), has_normal = present(normal) && normal.get_bytespp()>=TGAImage::RGB, has_spec = present(specular);
+	std::vector<size_t> dcols, ncols, scols;
+	if (has_diffuse) dcols = nearest_columns(diffuse, width_);
+	if (has_normal)  ncols = nearest_columns(normal, width_);
+	if (has_spec)    scols = nearest_columns(specular, width_);
+	int dbpp = diffuse.get_bytespp();
+	for (int y=0; y<height_; y++) {
+		SurfaceTexel *t = texels_.data()+size_t(y)*width_;
+		if (has_diffuse) {
+			const unsigned char *row = nearest_row(diffuse, y, height_);
+			for (int x=0; x<width_; x++) {
+				t[x].diffuse = 0;
+				memcpy(&t[x].diffuse, row+dcols[x], dbpp); // as TGAImage::get, unused bytes stay 0
+			}
+		}
+		if (has_normal) {
+			const unsigned char *row = nearest_row(normal, y, height_);
+			for (int x=0; x<width_; x++) {
+				const unsigned char *p = row+ncols[x];
+				t[x].nx = p[2];
+				t[x].ny = p[1];
+				t[x].nz = p[0];
+			}
+		}
+		if (has_spec) {
+			const unsigned char *row = nearest_row(specular, y, height_);
+			for (int x=0; x<width_; x++) t[x].spec = row[scols[x]];
+		}
+	}
+}
+
+bool SurfaceTexture::empty() const {
+	return texels_.empty();
+}
+
+size_t SurfaceTexture::bytes() const {
+	return texels_.size()*sizeof(SurfaceTexel);
+}
@@ -0,0 +1,83 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <vector>
+#include <cstdint>
+#include "geometry.h"
+#include "tgaimage.h"
+
+enum TextureFilter {
+	FILTER_POINT,     // unfiltered lookup in the decoded TGAImage, the original behaviour
+	FILTER_NEAREST,   // nearest texel of the nearest mip level
+	FILTER_BILINEAR,  // 2x2 texels of the nearest mip level
+	FILTER_TRILINEAR  // bilinear in the two closest mip levels, blended
+};
+
+// texels read per sample, for the statistics
+inline int filter_taps(TextureFilter filter) {
+	return filter==FILTER_TRILINEAR ? 8 : filter==FILTER_BILINEAR ? 4 : 1;
+}
+
+const int TEXTURE_BLOCK = 4;
+
+// Diffuse texture prepared for filtered sampling: a full mip chain (2x2 box filter down to 1x1)
+// of BGRA8 texels packed in uint32 words, the TGAColor byte order. Every level is stored in 4x4
+// texel blocks of 64 bytes, so a bilinear footprint touches one or two cache lines whatever the
+// direction the texture is walked in. Addressing clamps to the edge.
+class Texture {
+private:
+	struct Level {
+		int width, height;
+		int bw;        // blocks per row
+		size_t offset; // first texel of the level in texels_
+	};
+	std::vector<uint32_t> texels_;
+	std::vector<Level> levels_;
+	inline uint32_t texel(const Level &l, int x, int y) const;
+	uint32_t bilinear(int level, float u, float v) const;
+public:
+	Texture();
+	// rebuilds the chain from a GRAYSCALE, RGB or RGBA image
+	void build(TGAImage &img);
+	bool empty() const;
+	int nlevels() const;
+	int width(int level) const;
+	int height(int level) const;
+	size_t bytes() const;
+	uint32_t fetch(int level, int x, int y) const;
+	// level of detail from the screen-space derivatives of uv, in level 0 texels; the rasterizer
+	// takes them per 2x2 pixel quad (QuadLod in rasterizer.h)
+	float lod(float dudx, float dvdx, float dudy, float dvdy) const;
+	uint32_t sample(float u, float v, float lod, TextureFilter filter) const;
+};
+
+// Diffuse colour (TGAColor byte order), normal (x, y, z in 0..255 for -1..1) and specular exponent
+// of one texel: 8 aligned bytes, a fragment reads all of them from a single cache line.
+struct SurfaceTexel {
+	uint32_t diffuse;
+	unsigned char nx, ny, nz, spec;
+};
+
+// The diffuse, normal and specular maps of a model interleaved texel by texel, at the resolution
+// of the diffuse map (the others are resampled to it, nearest texel). Missing maps leave their
+// defaults: black, the unperturbed normal (0, 0, 1), exponent 0. Point sampled and addressed as
+// Model::diffuse(uv), which it reproduces exactly; outside the map a default texel is returned.
+class SurfaceTexture {
+private:
+	int width_, height_;
+	std::vector<SurfaceTexel> texels_;
+	static const SurfaceTexel outside_;
+public:
+	SurfaceTexture();
+	// empty images are the missing maps
+	void build(TGAImage &diffuse, TGAImage &normal, TGAImage &specular);
+	bool empty() const;
+	size_t bytes() const;
+	const SurfaceTexel &fetch(Vec2f uv) const {
+		int x = int(uv.x*width_), y = int(uv.y*height_);
+		if (x<0 || y<0 || x>=width_ || y>=height_) return outside_;
+		return texels_[x+size_t(y)*width_];
+	}
+};
+
+#endif //__TEXTURE_H__
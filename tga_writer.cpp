@@ -0,0 +1,207 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include "tga_writer.h"
+#include "profile.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+static const int BAND_ROWS = 32;
+static const int MAX_PACKET = 128;
+
+// developer and extension area offsets (none) and the TGA 2.0 signature
+static const unsigned char TGA_FOOTER[26] = {0,0,0,0, 0,0,0,0, 'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+
+template <int BPP> static inline bool same_pixel(const unsigned char *a, const unsigned char *b) {
+    if (BPP==4) {
+        uint32_t x, y;
+        memcpy(&x, a, 4);
+        memcpy(&y, b, 4);
+        return x==y;
+    }
+    if (BPP==3) return a[0]==b[0] && a[1]==b[1] && a[2]==b[2];
+    return a[0]==b[0];
+}
+
+// raw packets for pixels [from, to)
+template <int BPP> static inline unsigned char *raw_packets(const unsigned char *pixels, int from, int to, unsigned char *out) {
+    for (int s=from; s<to; s+=MAX_PACKET) {
+        int len = std::min(MAX_PACKET, to-s);
+        *out++ = (unsigned char)(len-1);
+        memcpy(out, pixels+s*BPP, len*BPP);
+        out += len*BPP;
+    }
+    return out;
+}
+
+// RLE packets for n consecutive pixels, out must hold n*BPP + n/128+1 bytes; returns the end
+template <int BPP> static unsigned char *encode_pixels(const unsigned char *pixels, int n, unsigned char *out) {
+    const int min_run = BPP==1 ? 3 : 2;
+    int x = 0, raw_start = 0;
+    while (x<n) {
+        int run = 1;
+        while (x+run<n && run<MAX_PACKET && same_pixel<BPP>(pixels+x*BPP, pixels+(x+run)*BPP)) run++;
+        if (run<min_run) {
+            x += run;
+            continue;
+        }
+        out = raw_packets<BPP>(pixels, raw_start, x, out);
+        *out++ = (unsigned char)(run+127);
+        memcpy(out, pixels+x*BPP, BPP);
+        out += BPP;
+        x += run;
+        raw_start = x;
+    }
+    return raw_packets<BPP>(pixels, raw_start, n, out);
+}
+
+TGAWriter::TGAWriter(ThreadPool *pool) : pool_(pool), bands_(), band_size_() {
+    memset(header_, 0, sizeof(header_));
+}
+
+// fills header_ and the band buffers, returns the number of bands (0 for an empty image)
+int TGAWriter::encode_bands(TGAImage &img, bool rle) {
+    int width = img.get_width(), height = img.get_height(), bpp = img.get_bytespp();
+    const unsigned char *data = img.buffer();
+    if (!data || width<=0 || height<=0) return 0;
+    TGA_Header header;
+    memset((void *)&header, 0, sizeof(header));
+    header.bitsperpixel = bpp<<3;
+    header.width  = width;
+    header.height = height;
+    header.datatypecode = (bpp==TGAImage::GRAYSCALE?(rle?11:3):(rle?10:2));
+    header.imagedescriptor = 0x20; // top-left origin
+    memcpy(header_, &header, sizeof(header));
+    if (!rle) return 1;
+
+    int nbands = (height+BAND_ROWS-1)/BAND_ROWS;
+    if ((int)bands_.size()<nbands) bands_.resize(nbands);
+    band_size_.assign(nbands, 0);
+    size_t band_pixels = size_t(BAND_ROWS)*width;
+    size_t worst = band_pixels*bpp + band_pixels/MAX_PACKET+1;
+    auto encode = [&](int b) {
+        PROFILE_SCOPE("tga encode band");
+        std::vector<unsigned char> &buf = bands_[b];
+        if (buf.size()<worst) buf.resize(worst);
+        int y0 = b*BAND_ROWS, y1 = std::min(height, y0+BAND_ROWS);
+        const unsigned char *src = data+size_t(y0)*width*bpp;
+        int n = (y1-y0)*width;
+        unsigned char *end;
+        switch (bpp) {
+            case 4:  end = encode_pixels<4>(src, n, buf.data()); break;
+            case 3:  end = encode_pixels<3>(src, n, buf.data()); break;
+            default: end = encode_pixels<1>(src, n, buf.data()); break;
+        }
+        band_size_[b] = end-buf.data();
+    };
+    if (pool_) {
+        pool_->parallel_for(nbands, encode);
+    } else {
+        for (int b=0; b<nbands; b++) encode(b);
+    }
+    return nbands;
+}
+
+bool TGAWriter::encode(TGAImage &img, std::vector<unsigned char> &out, bool rle) {
+    int nbands = encode_bands(img, rle);
+    out.clear();
+    if (!nbands) return false;
+    size_t raw = size_t(img.get_width())*img.get_height()*img.get_bytespp();
+    size_t total = sizeof(header_) + sizeof(TGA_FOOTER);
+    if (rle) {
+        for (int b=0; b<nbands; b++) total += band_size_[b];
+    } else {
+        total += raw;
+    }
+    out.resize(total);
+    unsigned char *p = out.data();
+    memcpy(p, header_, sizeof(header_));
+    p += sizeof(header_);
+    if (rle) {
+        for (int b=0; b<nbands; b++) {
+            memcpy(p, bands_[b].data(), band_size_[b]);
+            p += band_size_[b];
+        }
+    } else {
+        memcpy(p, img.buffer(), raw);
+        p += raw;
+    }
+    memcpy(p, TGA_FOOTER, sizeof(TGA_FOOTER));
+    return true;
+}
+
+bool TGAWriter::write(TGAImage &img, const char *filename, bool rle) {
+    PROFILE_SCOPE("tga write");
+    int nbands = encode_bands(img, rle);
+    if (!nbands) {
+        std::cerr << "can't dump an empty image to " << filename << "\n";
+        return false;
+    }
+    // header, bands (or the raw pixels), footer
+    std::vector<std::pair<const unsigned char *, size_t> > pieces;
+    pieces.push_back(std::make_pair(header_, sizeof(header_)));
+    if (rle) {
+        for (int b=0; b<nbands; b++) pieces.push_back(std::make_pair(bands_[b].data(), band_size_[b]));
+    } else {
+        pieces.push_back(std::make_pair(img.buffer(), size_t(img.get_width())*img.get_height()*img.get_bytespp()));
+    }
+    pieces.push_back(std::make_pair(TGA_FOOTER, sizeof(TGA_FOOTER)));
+    size_t bytes = 0;
+    for (size_t i=0; i<pieces.size(); i++) bytes += pieces[i].second;
+    profile_count(COUNT_BYTES_WRITTEN, bytes);
+#ifndef _WIN32
+    int fd = ::open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd<0) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    std::vector<struct iovec> iov(pieces.size());
+    for (size_t i=0; i<pieces.size(); i++) {
+        iov[i].iov_base = (void *)pieces[i].first;
+        iov[i].iov_len  = pieces[i].second;
+    }
+    // writev may stop short or take at most IOV_MAX pieces, resume where it left off
+    size_t first = 0;
+    while (first<iov.size()) {
+        int count = (int)std::min(iov.size()-first, (size_t)IOV_MAX);
+        ssize_t n = ::writev(fd, &iov[first], count);
+        if (n<0) {
+            std::cerr << "can't dump the tga file\n";
+            ::close(fd);
+            return false;
+        }
+        while (first<iov.size() && (size_t)n>=iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            first++;
+        }
+        if (first<iov.size()) {
+            iov[first].iov_base = (char *)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    if (::close(fd)!=0) {
+        std::cerr << "can't dump the tga file\n";
+        return false;
+    }
+    return true;
+#else
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    for (size_t i=0; i<pieces.size(); i++) out.write((const char *)pieces[i].first, pieces[i].second);
+    out.close();
+    if (!out.good()) {
+        std::cerr << "can't dump the tga file\n";
+        return false;
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef __TGA_WRITER_H__
+#define __TGA_WRITER_H__
+
+#include <vector>
+#include "tgaimage.h"
+#include "threadpool.h"
+
+// TGA encoder. The image is cut into bands of scanlines that are RLE-encoded independently (in
+// parallel when a pool is given) into reusable memory buffers; packets may span the scanlines of
+// a band, as with the former encoder, but never two bands, so the bands simply concatenate.
+// The file is then written with a single gathered write.
+// Runs of 2+ equal pixels (3+ for grayscale) become run packets, which gives the smallest
+// possible output for 24 and 32-bit images.
+class TGAWriter {
+private:
+	ThreadPool *pool_;
+	std::vector<std::vector<unsigned char> > bands_;
+	std::vector<size_t> band_size_;
+	unsigned char header_[18];
+	int encode_bands(TGAImage &img, bool rle);
+public:
+	TGAWriter(ThreadPool *pool=NULL);
+	// the complete file in memory, out is replaced; returns false for an empty image
+	bool encode(TGAImage &img, std::vector<unsigned char> &out, bool rle=true);
+	bool write(TGAImage &img, const char *filename, bool rle=true);
+};
+
+#endif //__TGA_WRITER_H__
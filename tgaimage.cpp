@@ -3,7 +3,11 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <algorithm>
 #include "tgaimage.h"
+#include "tga_writer.h"
+#include "mapped_file.h"
+#include "profile.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
 }
@@ -40,214 +44,139 @@ TGAImage & TGAImage::operator =(const TGAImage &img) {
 	return *this;
 }
 
-bool TGAImage::read_tga_file(const char *filename) {
+// n copies of one pixel; long runs go through a 16-pixel pattern so that the copies are wide stores
+template <int BPP> static inline void fill_pixels(unsigned char *dst, const unsigned char *px, int n) {
+	if (n<16) {
+		for (int i=0; i<n; i++, dst+=BPP) memcpy(dst, px, BPP);
+		return;
+	}
+	unsigned char pattern[16*BPP];
+	for (int i=0; i<16; i++) memcpy(pattern+i*BPP, px, BPP);
+	for (; n>=16; n-=16, dst+=sizeof(pattern)) memcpy(dst, pattern, sizeof(pattern));
+	memcpy(dst, pattern, n*BPP);
+}
+
+static inline void fill_pixels(unsigned char *dst, const unsigned char *px, int n, int bpp) {
+	switch (bpp) {
+		case 1: memset(dst, px[0], n); break;
+		case 3: fill_pixels<3>(dst, px, n); break;
+		default: fill_pixels<4>(dst, px, n); break;
+	}
+}
+
+// Decodes straight from the mapped file: rows land in their final place (file origin vs the
+// requested one) as they are produced, packets are expanded with bulk copies.
+bool TGAImage::read_tga_file(const char *filename, bool bottom_up) {
+	PROFILE_SCOPE("tga read");
 	if (data) delete [] data;
 	data = NULL;
-	std::ifstream in;
-	in.open (filename, std::ios::binary);
-	if (!in.is_open()) {
+	MappedFile file;
+	if (!file.open(filename)) {
 		std::cerr << "can't open file " << filename << "\n";
-		in.close();
 		return false;
 	}
+	const unsigned char *p = (const unsigned char *)file.data(), *end = p+file.size();
 	TGA_Header header;
-	in.read((char *)&header, sizeof(header));
-	if (!in.good()) {
-		in.close();
+	if (file.size()<sizeof(header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
+	memcpy(&header, p, sizeof(header));
 	width   = header.width;
 	height  = header.height;
 	bytespp = header.bitsperpixel>>3;
 	if (width<=0 || height<=0 || (bytespp!=GRAYSCALE && bytespp!=RGB && bytespp!=RGBA)) {
-		in.close();
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
-	unsigned long nbytes = bytespp*width*height;
-	data = new unsigned char[nbytes];
+	// the image id and the color map (unused for true color images) precede the pixels
+	size_t skip = sizeof(header) + (unsigned char)header.idlength;
+	if (header.colormaptype) skip += size_t(header.colormaplength)*((header.colormapdepth+7)>>3);
+	p += std::min(skip, file.size());
+	if (3!=header.datatypecode && 2!=header.datatypecode && 10!=header.datatypecode && 11!=header.datatypecode) {
+		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
+		return false;
+	}
+	size_t rowbytes = size_t(width)*bytespp;
+	data = new unsigned char[rowbytes*height];
+	// file rows go downwards for a top-left origin, upwards otherwise
+	bool file_top_down = (header.imagedescriptor & 0x20)!=0;
+	bool reverse = file_top_down==bottom_up;
+	unsigned char *row0 = reverse ? data+rowbytes*(height-1) : data;
+	ptrdiff_t rowstep = reverse ? -(ptrdiff_t)rowbytes : (ptrdiff_t)rowbytes;
+
 	if (3==header.datatypecode || 2==header.datatypecode) {
-		in.read((char *)data, nbytes);
-		if (!in.good()) {
-			in.close();
+		if (size_t(end-p)<rowbytes*height) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
-	} else if (10==header.datatypecode||11==header.datatypecode) {
-		if (!load_rle_data(in)) {
-			in.close();
-			std::cerr << "an error occured while reading the data\n";
-			return false;
+		if (!reverse) {
+			memcpy(data, p, rowbytes*height);
+		} else {
+			for (int r=0; r<height; r++) memcpy(row0+r*rowstep, p+r*rowbytes, rowbytes);
 		}
-	} else {
-		in.close();
-		std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
+	} else if (!load_rle_data(p, end, row0, rowstep)) {
+		std::cerr << "an error occured while reading the data\n";
 		return false;
 	}
-	if (!(header.imagedescriptor & 0x20)) {
-		flip_vertically();
-	}
 	if (header.imagedescriptor & 0x10) {
 		flip_horizontally();
 	}
 	std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
-	in.close();
 	return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-	unsigned long pixelcount = width*height;
-	unsigned long currentpixel = 0;
-	unsigned long currentbyte  = 0;
-	TGAColor colorbuffer;
-	do {
-		unsigned char chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
+// RLE packets may span rows, the destination pointer moves on to the next row when one is full
+bool TGAImage::load_rle_data(const unsigned char *p, const unsigned char *end, unsigned char *row0, ptrdiff_t rowstep) {
+	int row = 0, x = 0;
+	unsigned char *dst = row0;
+	size_t pixelcount = size_t(width)*height;
+	size_t currentpixel = 0;
+	while (currentpixel<pixelcount) {
+		if (p>=end) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
-		if (chunkheader<128) {
-			chunkheader++;
-			for (int i=0; i<chunkheader; i++) {
-				in.read((char *)colorbuffer.raw, bytespp);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
-		} else {
-			chunkheader -= 127;
-			in.read((char *)colorbuffer.raw, bytespp);
-			if (!in.good()) {
-				std::cerr << "an error occured while reading the header\n";
-				return false;
-			}
-			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<bytespp; t++)
-					data[currentbyte++] = colorbuffer.raw[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
-			}
-		}
-	} while (currentpixel < pixelcount);
-	return true;
-}
-
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
-	unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-	unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-	unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
-	std::ofstream out;
-	out.open (filename, std::ios::binary);
-	if (!out.is_open()) {
-		std::cerr << "can't open file " << filename << "\n";
-		out.close();
-		return false;
-	}
-	TGA_Header header;
-	memset((void *)&header, 0, sizeof(header));
-	header.bitsperpixel = bytespp<<3;
-	header.width  = width;
-	header.height = height;
-	header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-	header.imagedescriptor = 0x20; // top-left origin
-	out.write((char *)&header, sizeof(header));
-	if (!out.good()) {
-		out.close();
-		std::cerr << "can't dump the tga file\n";
-		return false;
-	}
-	if (!rle) {
-		out.write((char *)data, width*height*bytespp);
-		if (!out.good()) {
-			std::cerr << "can't unload raw data\n";
-			out.close();
+		unsigned char chunkheader = *p++;
+		int n = (chunkheader & 0x7f) + 1;
+		bool run = chunkheader>=128;
+		size_t need = run ? bytespp : size_t(n)*bytespp;
+		if (size_t(end-p)<need) {
+			std::cerr << "an error occured while reading the header\n";
 			return false;
 		}
-	} else {
-		if (!unload_rle_data(out)) {
-			out.close();
-			std::cerr << "can't unload rle data\n";
+		if (currentpixel+n>pixelcount) {
+			std::cerr << "Too many pixels read\n";
 			return false;
 		}
-	}
-	out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
-	}
-	out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
-	}
-	out.write((char *)footer, sizeof(footer));
-	if (!out.good()) {
-		std::cerr << "can't dump the tga file\n";
-		out.close();
-		return false;
-	}
-	out.close();
-	return true;
-}
-
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-	const unsigned char max_chunk_length = 128;
-	unsigned long npixels = width*height;
-	unsigned long curpix = 0;
-	while (curpix<npixels) {
-		unsigned long chunkstart = curpix*bytespp;
-		unsigned long curbyte = curpix*bytespp;
-		unsigned char run_length = 1;
-		bool raw = true;
-		while (curpix+run_length<npixels && run_length<max_chunk_length) {
-			bool succ_eq = true;
-			for (int t=0; succ_eq && t<bytespp; t++) {
-				succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-			}
-			curbyte += bytespp;
-			if (1==run_length) {
-				raw = !succ_eq;
+		currentpixel += n;
+		while (n>0) {
+			int len = std::min(n, width-x);
+			if (run) {
+				fill_pixels(dst+x*bytespp, p, len, bytespp);
+			} else {
+				memcpy(dst+x*bytespp, p, size_t(len)*bytespp);
+				p += size_t(len)*bytespp;
 			}
-			if (raw && succ_eq) {
-				run_length--;
-				break;
+			n -= len;
+			x += len;
+			if (x==width) {
+				x = 0;
+				row++;
+				dst = row0+row*rowstep;
 			}
-			if (!raw && !succ_eq) {
-				break;
-			}
-			run_length++;
-		}
-		curpix += run_length;
-		out.put(raw?run_length-1:run_length+127);
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
-		}
-		out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-		if (!out.good()) {
-			std::cerr << "can't dump the tga file\n";
-			return false;
 		}
+		if (run) p += bytespp;
 	}
 	return true;
 }
 
+// see TGAWriter, which also offers parallel encoding and encoding to memory
+bool TGAImage::write_tga_file(const char *filename, bool rle) {
+	TGAWriter writer;
+	return writer.write(*this, filename, rle);
+}
+
 TGAColor TGAImage::get(int x, int y) {
 	if (!data || x<0 || y<0 || x>=width || y>=height) {
 		return TGAColor();
@@ -277,13 +206,14 @@ int TGAImage::get_height() {
 
 bool TGAImage::flip_horizontally() {
 	if (!data) return false;
-	int half = width>>1;
-	for (int i=0; i<half; i++) {
-		for (int j=0; j<height; j++) {
-			TGAColor c1 = get(i, j);
-			TGAColor c2 = get(width-1-i, j);
-			set(i, j, c2);
-			set(width-1-i, j, c1);
+	unsigned char tmp[4];
+	for (int j=0; j<height; j++) {
+		unsigned char *l = data+size_t(j)*width*bytespp;
+		unsigned char *r = l+size_t(width-1)*bytespp;
+		for (; l<r; l+=bytespp, r-=bytespp) {
+			memcpy(tmp, l, bytespp);
+			memcpy(l, r, bytespp);
+			memcpy(r, tmp, bytespp);
 		}
 	}
 	return true;
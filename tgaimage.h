@@ -2,6 +2,7 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <cstddef>
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -67,8 +68,7 @@ protected:
 	int height;
 	int bytespp;
 
-	bool   load_rle_data(std::ifstream &in);
-	bool unload_rle_data(std::ofstream &out);
+	bool load_rle_data(const unsigned char *p, const unsigned char *end, unsigned char *row0, ptrdiff_t rowstep);
 public:
 	enum Format {
 		GRAYSCALE=1, RGB=3, RGBA=4
@@ -77,7 +77,8 @@ public:
 	TGAImage();
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage &img);
-	bool read_tga_file(const char *filename);
+	// bottom_up stores the last row first (origin at the bottom left), saving a flip_vertically()
+	bool read_tga_file(const char *filename, bool bottom_up=false);
 	bool write_tga_file(const char *filename, bool rle=true);
 	bool flip_horizontally();
 	bool flip_vertically();
@@ -0,0 +1,35 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// fixed set of worker threads; the calling thread takes part in every parallel_for
+class ThreadPool {
+private:
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+	const std::function<void(int)> *job_;
+	int njobs_;
+	std::atomic<int> next_;
+	int busy_;
+	unsigned generation_;
+	bool stop_;
+	void run_jobs();
+	void worker_loop();
+public:
+	ThreadPool(int nthreads);
+	~ThreadPool();
+	int size() const;
+	// calls fn(i) for every i in [0,n), returns when all calls are finished
+	void parallel_for(int n, const std::function<void(int)> &fn);
+	static int default_threads();
+};
+
+#endif //__THREADPOOL_H__
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include "tiler.h"
+#include "profile.h"
+
+Tiler::Tiler(int width, int height) : width_(width), height_(height), bin_start_(), bin_tris_() {
+    ntx_ = (width +TILE_SIZE-1)/TILE_SIZE;
+    nty_ = (height+TILE_SIZE-1)/TILE_SIZE;
+}
+
+int Tiler::ntiles() const {
+    return ntx_*nty_;
+}
+
+// range of tiles covered by the bounding box of a triangle, false if it misses the screen entirely
+bool Tiler::tile_range(const Vec3f pts[3], Vec2i &tmin, Vec2i &tmax) const {
+    Vec2i bboxmin, bboxmax;
+    bounding_box(pts, bboxmin, bboxmax);
+    if (bboxmax.x<0 || bboxmax.y<0 || bboxmin.x>=width_ || bboxmin.y>=height_) return false;
+    tmin = Vec2i(std::max(bboxmin.x, 0)/TILE_SIZE, std::max(bboxmin.y, 0)/TILE_SIZE);
+    tmax = Vec2i(std::min(bboxmax.x, width_-1)/TILE_SIZE, std::min(bboxmax.y, height_-1)/TILE_SIZE);
+    return true;
+}
+
+template <class Triangle> void Tiler::build_bins(const std::vector<Triangle> &tris) {
+    PROFILE_SCOPE("binning");
+    // two passes (count, then scatter) keep every bin in one flat array
+    bin_start_.assign(ntiles()+1, 0);
+    Vec2i tmin, tmax;
+    for (int t=0; t<(int)tris.size(); t++) {
+        if (!tile_range(tris[t].pts, tmin, tmax)) continue;
+        for (int ty=tmin.y; ty<=tmax.y; ty++)
+            for (int tx=tmin.x; tx<=tmax.x; tx++)
+                bin_start_[tx+ty*ntx_+1]++;
+    }
+    for (int i=0; i<ntiles(); i++) {
+        bin_start_[i+1] += bin_start_[i];
+    }
+    bin_tris_.resize(bin_start_[ntiles()]);
+    std::vector<int> fill(bin_start_.begin(), bin_start_.end()-1);
+    for (int t=0; t<(int)tris.size(); t++) {
+        if (!tile_range(tris[t].pts, tmin, tmax)) continue;
+        for (int ty=tmin.y; ty<=tmax.y; ty++)
+            for (int tx=tmin.x; tx<=tmax.x; tx++)
+                bin_tris_[fill[tx+ty*ntx_]++] = t;
+    }
+}
+
+void Tiler::bin(const std::vector<ScreenTriangle> &tris) {
+    build_bins(tris);
+}
+
+void Tiler::bin(const std::vector<ShadedTriangle> &tris) {
+    build_bins(tris);
+}
+
+void Tiler::bin(const std::vector<DepthTriangle> &tris) {
+    build_bins(tris);
+}
+
+int Tiler::bin_size(int tile) const {
+    return bin_start_[tile+1]-bin_start_[tile];
+}
+
+const int *Tiler::bin_triangles(int tile) const {
+    return bin_tris_.data()+bin_start_[tile];
+}
+
+void Tiler::tile_rect(int tile, Vec2i &clipmin, Vec2i &clipmax) const {
+    int tx = tile%ntx_, ty = tile/ntx_;
+    clipmin = Vec2i(tx*TILE_SIZE, ty*TILE_SIZE);
+    clipmax = Vec2i(std::min(clipmin.x+TILE_SIZE, width_)-1, std::min(clipmin.y+TILE_SIZE, height_)-1);
+}
+
+void Tiler::render(const std::vector<ScreenTriangle> &tris, RasterMode mode, TGAImage &image, float *zbuffer, HiZBuffer *hiz, Model &model, ThreadPool &pool) {
+    PROFILE_SCOPE("raster");
+    pool.parallel_for(ntiles(), [&](int tile) {
+        if (bin_start_[tile]==bin_start_[tile+1]) return;
+        PROFILE_SCOPE("raster tile");
+        Vec2i clipmin, clipmax;
+        tile_rect(tile, clipmin, clipmax);
+        for (int i=bin_start_[tile]; i<bin_start_[tile+1]; i++) {
+            if (hiz) {
+                rasterize_hiz(tris[bin_tris_[i]], mode, image, zbuffer, *hiz, model, clipmin, clipmax);
+            } else {
+                rasterize(tris[bin_tris_[i]], mode, image, zbuffer, model, clipmin, clipmax);
+            }
+        }
+    });
+}
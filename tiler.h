@@ -0,0 +1,35 @@
+#ifndef __TILER_H__
+#define __TILER_H__
+
+#include <vector>
+#include "rasterizer.h"
+#include "threadpool.h"
+#include "hiz.h"
+
+const int TILE_SIZE = 64; // multiple of HIZ_TILE, so HiZ tiles are never shared between workers
+
+// Binned rasterizer: triangles are sorted into the screen tiles their bounding boxes overlap,
+// then every tile is rasterized by a single worker, so zbuffer/image writes never race.
+// Inside a tile triangles keep their submission order, hence the result equals the serial loop.
+class Tiler {
+private:
+	int width_, height_;
+	int ntx_, nty_;
+	std::vector<int> bin_start_; // tile i owns bin_tris_[bin_start_[i] .. bin_start_[i+1])
+	std::vector<int> bin_tris_;
+	bool tile_range(const Vec3f pts[3], Vec2i &tmin, Vec2i &tmax) const;
+	template <class Triangle> void build_bins(const std::vector<Triangle> &tris);
+public:
+	Tiler(int width, int height);
+	int ntiles() const;
+	void bin(const std::vector<ScreenTriangle> &tris);
+	void bin(const std::vector<ShadedTriangle> &tris);
+	void bin(const std::vector<DepthTriangle> &tris);
+	// triangles binned into a tile, in submission order, and the pixels the tile covers
+	int bin_size(int tile) const;
+	const int *bin_triangles(int tile) const;
+	void tile_rect(int tile, Vec2i &clipmin, Vec2i &clipmax) const;
+	void render(const std::vector<ScreenTriangle> &tris, RasterMode mode, TGAImage &image, float *zbuffer, HiZBuffer *hiz, Model &model, ThreadPool &pool);
+};
+
+#endif //__TILER_H__
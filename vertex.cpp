@@ -0,0 +1,43 @@
+#include <algorithm>
+#include "vertex.h"
+#include "profile.h"
+
+VertexProcessor::VertexProcessor() : clip_(), screen_(), transformed_(0), referenced_(0) {
+}
+
+void VertexProcessor::transform(Model &model, const mat4 &MVP, ThreadPool &pool) {
+    PROFILE_SCOPE("vertex transform");
+    const int chunk = 1024;
+    int n = model.nverts();
+    const float *x = model.vert_component(0), *y = model.vert_component(1), *z = model.vert_component(2);
+    clip_.resize(n);
+    screen_.resize(n);
+    pool.parallel_for((n+chunk-1)/chunk, [&](int c) {
+        int end = std::min(n, (c+1)*chunk);
+        for (int i=c*chunk; i<end; i++) {
+            vec4 v = MVP*embed(Vec3f(x[i], y[i], z[i]));
+            clip_[i] = v;
+            screen_[i] = Vec3f(v[0]/v[3], v[1]/v[3], v[2]/v[3]);
+        }
+    });
+    transformed_ = n;
+    referenced_ = 0;
+}
+
+const vec4 &VertexProcessor::clip(int i) const {
+    return clip_[i];
+}
+
+const Vec3f &VertexProcessor::screen(int i) const {
+    return screen_[i];
+}
+
+void VertexProcessor::count_references(long n) {
+    referenced_ += n;
+}
+
+void VertexProcessor::print_stats(std::ostream &s) const {
+    s << "# vertices transformed " << transformed_ << ", referenced " << referenced_;
+    if (transformed_) s << " (" << double(referenced_)/transformed_ << "x reuse)";
+    s << std::endl;
+}
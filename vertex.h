@@ -0,0 +1,31 @@
+#ifndef __VERTEX_H__
+#define __VERTEX_H__
+
+#include <vector>
+#include <iostream>
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "threadpool.h"
+
+// Vertex stage: every model vertex is transformed exactly once into a buffer indexed by vertex
+// number (the post-transform cache); primitive assembly (PrimitiveCuller) then reads it through
+// the face index triples instead of transforming each corner again.
+// Both the homogeneous position (before the perspective divide, used for clipping) and the
+// projected screen position are kept.
+class VertexProcessor {
+private:
+	std::vector<vec4> clip_;
+	std::vector<Vec3f> screen_;
+	long transformed_;
+	long referenced_;
+public:
+	VertexProcessor();
+	void transform(Model &model, const mat4 &MVP, ThreadPool &pool);
+	const vec4 &clip(int i) const;
+	const Vec3f &screen(int i) const;
+	void count_references(long n);
+	void print_stats(std::ostream &s) const;
+};
+
+#endif //__VERTEX_H__